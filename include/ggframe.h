@@ -1,5 +1,10 @@
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
 
 #if APPLE
 #include <boost/filesystem.hpp>
@@ -88,46 +93,636 @@ namespace ggframe
         R, G, B, A
     };
 
+    /* byte order of one pixel in a buffer handed to Frame::wrap */
+    enum class PixelFormat {
+        BGRA8, BGR8, Gray8
+    };
+
+    /* Pixel layouts for BasicFrame. offset() is the byte of a color within
+     * one pixel; Gray8 answers R, G and B with its single channel, which
+     * holds max(R,G,B) like the grayscale used for feature detection. */
+    struct BGRA8
+    {
+        static constexpr PixelFormat format = PixelFormat::BGRA8;
+        static constexpr unsigned channels = 4;
+        static constexpr int cvType = CV_8UC4;
+        static constexpr bool has(Color) { return true; }
+        static constexpr unsigned offset(Color color)
+        {
+            return color == Color::B ? 0 : color == Color::G ? 1 : color == Color::R ? 2 : 3;
+        }
+    };
+
+    struct BGR8
+    {
+        static constexpr PixelFormat format = PixelFormat::BGR8;
+        static constexpr unsigned channels = 3;
+        static constexpr int cvType = CV_8UC3;
+        static constexpr bool has(Color color) { return color != Color::A; }
+        static constexpr unsigned offset(Color color)
+        {
+            return color == Color::B ? 0 : color == Color::G ? 1 : 2;
+        }
+    };
+
+    struct Gray8
+    {
+        static constexpr PixelFormat format = PixelFormat::Gray8;
+        static constexpr unsigned channels = 1;
+        static constexpr int cvType = CV_8UC1;
+        static constexpr bool has(Color color) { return color != Color::A; }
+        static constexpr unsigned offset(Color) { return 0; }
+    };
+
+    /* Converts between two pixel formats, dst is (re)allocated as needed. */
+    void convertPixels(cv::Mat const& src, PixelFormat from, cv::Mat& dst, PixelFormat to);
+
+    class Frame;
+
+    /* A frame whose pixel format is fixed at compile time, so channel
+     * access compiles down to a constant offset. Copies are deep; convert
+     * with to<Format>() or to and from Frame, which is always BGRA8. */
+    template<class Format>
+    class BasicFrame
+    {
+        template<class> friend class BasicFrame;
+        friend class Frame;
+        cv::Mat m_image;
+    public:
+        BasicFrame() = default;
+        BasicFrame(unsigned nrows, unsigned ncols)
+            : m_image(nrows, ncols, Format::cvType, cv::Scalar::all(0)) {}
+        BasicFrame(BasicFrame const& other) : m_image(other.m_image.clone()) {}
+        BasicFrame& operator=(BasicFrame const& other)
+        {
+            m_image = other.m_image.clone();
+            return *this;
+        }
+        BasicFrame(BasicFrame&& other) noexcept = default;
+        BasicFrame& operator=(BasicFrame&& other) noexcept = default;
+
+        template<Color color>
+        uint8_t get(unsigned r, unsigned c) const
+        {
+            static_assert(Format::has(color), "color not stored in this pixel format");
+            return m_image.ptr(r)[c * Format::channels + Format::offset(color)];
+        }
+
+        template<Color color>
+        void set(unsigned r, unsigned c, uint8_t v)
+        {
+            static_assert(Format::has(color), "color not stored in this pixel format");
+            m_image.ptr(r)[c * Format::channels + Format::offset(color)] = v;
+        }
+
+        uint8_t const* row(unsigned r) const { return m_image.ptr(r); }
+        uint8_t* row(unsigned r) { return m_image.ptr(r); }
+        size_t stride() const { return m_image.step; }
+        unsigned nCols() const { return m_image.cols; }
+        unsigned nRows() const { return m_image.rows; }
+        bool empty() const { return m_image.empty(); }
+
+        template<class To>
+        BasicFrame<To> to() const
+        {
+            BasicFrame<To> rtv;
+            convertPixels(m_image, Format::format, rtv.m_image, To::format);
+            return rtv;
+        }
+    };
+
+    class ScreenCapture;
+    class FramePool;
+    class FrameView;
+    class FeatureContext;
+
+    /* Keypoint detector and descriptor. Sift gives float descriptors
+     * matched by L2 distance; Orb, Akaze and Brisk give binary ones matched
+     * by Hamming distance, which are much cheaper for flat UI graphics.
+     * accuracy goes from 0 (fastest, fewest keypoints) to 1 (slowest, most
+     * keypoints); 0.5 is OpenCV's default for each detector, except that
+     * Orb uses a 19 px patch instead of 31 px. Patterns are
+     * padded before extraction so keypoints can sit near their edges;
+     * sprites smaller than about 16x16 still get too few keypoints with
+     * any backend and are better found with findTemplate or findExact. */
+    enum class FeatureBackend {
+        Sift, Orb, Akaze, Brisk
+    };
+
+    struct FeatureOptions
+    {
+        FeatureBackend backend = FeatureBackend::Sift;
+        float accuracy = 0.5f;
+        /* Pattern pixels with A below this are transparent and get no
+         * keypoints; 0 uses every pixel */
+        uint8_t minAlpha = 0;
+    };
+
+    /* The keypoints and descriptors of a Frame to search for, computed once
+     * so that findPattern only has to work on the scene. save() and load()
+     * store them with cv::FileStorage, in the format the file extension
+     * names (.yml, .xml or .json). */
+    class Pattern
+    {
+        friend class Frame;
+        vector<KeyPoint> m_keypoints;
+        cv::Mat m_descriptors;
+        FeatureBackend m_backend = FeatureBackend::Sift;
+        unsigned m_nrows = 0;
+        unsigned m_ncols = 0;
+        void compute(Frame const& frame, FeatureContext& ctx);
+    public:
+        Pattern() = default;
+        explicit Pattern(Frame const& frame);
+        Pattern(Frame const& frame, FeatureContext& ctx);
+        unsigned nCols() const;
+        unsigned nRows() const;
+        size_t nKeyPoints() const;
+        FeatureBackend backend() const;
+        bool empty() const;
+        void save(path filepath) const;
+        void load(path filepath);
+    };
+
+    /* How findPattern pairs pattern descriptors with scene descriptors.
+     * Flann builds an approximate index over the scene once per scene;
+     * SimdBruteForce is exact and fastest for small sets; Auto picks
+     * between those two by the number of descriptor pairs. */
+    enum class MatchStrategy {
+        BruteForce, Flann, SimdBruteForce, Auto
+    };
+
+    /* Geometric check of the matches: a RANSAC fit of a similarity
+     * (shift, rotation, uniform scale) or of a homography from pattern to
+     * scene. With None, findPattern boxes every matched keypoint. */
+    enum class Verification {
+        None, Similarity, Homography
+    };
+
+    struct MatchOptions
+    {
+        MatchStrategy strategy = MatchStrategy::BruteForce;
+        /* Lowe's ratio test: keep a match only when its distance is below
+         * ratio times the second best one; 0 keeps every best match */
+        float ratio = 0;
+        /* Auto uses SimdBruteForce up to this many pattern x scene pairs */
+        size_t maxBruteForcePairs = 256 * 1024;
+        Verification verification = Verification::None;
+        /* pixels a transformed pattern keypoint may be off to be an inlier */
+        float inlierThreshold = 3;
+        /* RANSAC stops as soon as a model has this many inliers */
+        unsigned minInliers = 8;
+        unsigned maxIterations = 500;
+    };
+
+    /* Where a pattern was found after geometric verification: the pattern's
+     * box mapped into the scene, and the share of its matches that agree
+     * with that mapping. */
+    struct PatternMatch
+    {
+        Rec rec;
+        float confidence = 0;
+        unsigned inliers = 0;
+        /* size of the match relative to the pattern */
+        float scale = 1;
+    };
+
+    /* Pixel comparison for findTemplate, both scored so that 1 is a
+     * perfect match: Ncc is OpenCV's zero-mean normalized cross
+     * correlation, Sad is one minus the mean absolute difference / 255. */
+    enum class TemplateMetric {
+        Ncc, Sad
+    };
+
+    struct TemplateOptions
+    {
+        TemplateMetric metric = TemplateMetric::Ncc;
+        /* matches scoring below this are dropped */
+        float minScore = 0.8f;
+        /* how many matches to return at most, best first */
+        unsigned topK = 1;
+        /* pyramid levels above full resolution; the default picks as many
+         * as keep the template at least minTemplateSize pixels wide */
+        int levels = -1;
+        unsigned minTemplateSize = 8;
+        /* template pixels with A below this are never compared, on coarse
+         * levels A is downsampled with the rest; 0 compares every pixel */
+        uint8_t minAlpha = 0;
+        /* template sizes to search for, e.g. { 1, 1.25f, 1.5f } for the
+         * usual display scalings */
+        vector<float> scales = { 1.f };
+        /* scales whose best coarse score is more than this below the best
+         * scale's are not refined */
+        float scalePruning = 0.1f;
+    };
+
+    struct TemplateMatch
+    {
+        Rec rec;
+        float score = 0;
+        /* the TemplateOptions::scales entry that matched */
+        float scale = 1;
+    };
+
+    /* A template prepared for findTemplate: the pyramid, and the opaque
+     * pixels of each level, for every scale in its options. Building one
+     * once and reusing it saves resizing the template on every search. */
+    class Template
+    {
+        friend class Frame;
+        struct Level
+        {
+            cv::Mat gray;
+            /* the pixels to compare, only filled when some are transparent */
+            vector<cv::Point> opaque;
+        };
+        struct Variant
+        {
+            float scale;
+            unsigned nrows;
+            unsigned ncols;
+            vector<Level> levels;
+        };
+        vector<Variant> m_variants;
+        TemplateOptions m_options;
+        void addVariant(Frame const& templ, float scale);
+    public:
+        Template() = default;
+        explicit Template(Frame const& templ, TemplateOptions const& opts = TemplateOptions());
+        TemplateOptions const& options() const;
+        bool empty() const;
+    };
+
+    /* Everything feature detection and matching needs between calls: the
+     * detector, the matchers, the mask and the keypoint/descriptor buffers.
+     * Reusing one context makes repeated searches allocation free once the
+     * buffers have grown. A context must not be used by two threads at
+     * once; Frames without one use a per-thread default. The debug hook,
+     * if set, sees every grayscale image and keypoints it extracts
+     * features from; findPattern has no other side effects. */
+    class FeatureContext
+    {
+    public:
+        typedef function<void(cv::Mat const& gray, vector<KeyPoint> const& keypoints)> DebugHook;
+    private:
+        friend class Frame;
+        friend class Pattern;
+        friend class PatternTracker;
+        /* pixels of context kept around a Rec, about the radius SIFT looks
+         * at around a keypoint on the first octaves */
+        static int const roi_margin = 16;
+        FeatureOptions m_feature_options;
+        cv::Ptr<cv::Feature2D> m_detector;
+        cv::Ptr<cv::DescriptorMatcher> m_matcher;
+        cv::Ptr<cv::DescriptorMatcher> m_flann;
+        bool m_flann_trained = false;
+        MatchOptions m_match_options;
+        vector<vector<DMatch>> m_knn;
+        cv::Mat m_mask;
+        vector<KeyPoint> m_scene_kps;
+        cv::Mat m_scene_desc;
+        Pattern m_pattern;
+        vector<DMatch> m_matches;
+        DebugHook m_debug_hook;
+        void detect(cv::Mat const& gray, Rec const& rec, vector<KeyPoint>& kps);
+        void detectAndCompute(cv::Mat const& gray, vector<KeyPoint>& kps, cv::Mat& desc,
+            cv::InputArray mask = cv::noArray());
+        MatchStrategy sceneStrategy(cv::Mat const& query) const;
+        void newScene();
+        void matchScene(cv::Mat const& query, vector<DMatch>& matches);
+    public:
+        FeatureContext();
+        FeatureContext(FeatureOptions const& options);
+        static FeatureContext& threadDefault();
+        void setFeatureOptions(FeatureOptions const& options);
+        FeatureOptions const& featureOptions() const;
+        void setDebugHook(DebugHook hook);
+        void setMatchOptions(MatchOptions const& options);
+        MatchOptions const& matchOptions() const;
+#if !GGFRAME_NO_HIGHGUI
+        /* the old findPattern behaviour: show the keypoints, wait for a key */
+        static DebugHook displayHook();
+#endif
+    };
+
     class Frame
     {
         typedef cv::Mat image_t;
+        friend class ScreenCapture;
+        friend class FramePool;
+        friend class FrameView;
+        friend class Pattern;
+        friend class Template;
+        friend class PatternTracker;
     private:
-        unique_ptr<image_t> m_image;
+        /* shared between copies, cloned by detach() before any write */
+        shared_ptr<image_t> m_image;
+        /* max(R,G,B) plane of m_image, built on demand by cvMat() and
+         * dropped by detach(), so every mutator invalidates it */
+        mutable shared_ptr<image_t const> m_gray;
         int m_grid_size = 1;
+        shared_ptr<FeatureContext> m_features;
+        void detach();
+        FeatureContext& featureContext() const;
         vector<KeyPoint> getSiftKeyPointsInRec(Rec const& rec) const;
+        vector<KeyPoint> getSiftKeyPointsInRec(Rec const& rec, FeatureContext& ctx) const;
+        void extractScene(FeatureContext& ctx) const;
+        /* only keypoints inside rec, which still see the pixels around it */
+        void extractScene(FeatureContext& ctx, Rec const& rec) const;
+        void matchPattern(Pattern const& pattern, FeatureContext& ctx) const;
+        Rec matchedRec(FeatureContext const& ctx) const;
+        optional<PatternMatch> verifiedMatch(Pattern const& pattern, FeatureContext const& ctx) const;
+        optional<Rec> patternRec(Pattern const& pattern, FeatureContext const& ctx) const;
+#if !GGFRAME_NO_HIGHGUI
         void showKeyPoints(vector<cv::KeyPoint> const& keypoints) const;
+#endif
         cv::Mat cvMat() const;
-        unsigned colorIndex(Color color) const;
+        static unsigned colorIndex(Color color);
 
     public:
         Frame();
         Frame(unsigned nrows, unsigned ncols);
         Frame(path filepath);
+        /* Uses an externally owned buffer as the Frame's pixels. BGRA8
+         * buffers are not copied: deleter (if any) runs once the last Frame
+         * or Mat using them is gone, and without one the buffer must outlive
+         * them. A stride of 0 means tightly packed rows. Other formats are
+         * converted into a new BGRA buffer and the deleter runs right away.
+         * Searches cache a grayscale copy of the pixels: call markModified()
+         * after the producer rewrites a wrapped buffer in place. */
+        static Frame wrap(uint8_t* data, unsigned nrows, unsigned ncols,
+            size_t stride, PixelFormat format = PixelFormat::BGRA8,
+            function<void(uint8_t*)> deleter = nullptr);
+        template<class Format>
+        explicit Frame(BasicFrame<Format> const& frame)
+            : m_image(make_shared<image_t>())
+        {
+            convertPixels(frame.m_image, Format::format, *m_image, PixelFormat::BGRA8);
+        }
         Frame(Frame const& other);
         Frame& operator=(Frame const& other);
+        /* copies share pixels until one of them is modified;
+         * a moved-from Frame is left empty */
+        Frame(Frame&& other) noexcept;
+        Frame& operator=(Frame&& other) noexcept;
+        /* drops what was computed from the pixels, for buffers written
+         * behind the Frame's back */
+        void markModified();
         void set(unsigned r, unsigned c, Color color, uint8_t v);
         uint8_t get(unsigned r, unsigned c, Color color) const;
         unsigned lastCol() const;
         unsigned lastRow() const;
         unsigned nCols() const;
         unsigned nRows() const;
+#if !GGFRAME_NO_HIGHGUI
         void display() const;
+#endif
         void drawGrid();
         void setGridSize(unsigned size);
         unsigned gridSize() const;
         void drawRec(Rec const& rec);
+#if !GGFRAME_NO_HIGHGUI
         void displaySift() const;
         void displaySiftInRec(Rec const& rec) const;
         InputEvent waitForInput();
+#endif
         void save(path filepath);
         void load(path filepath);
         Rec bestGridRecCenteredAt(Pos const&, Size const&);
         Rec frameRec() const;
         Rec findPattern(Frame const& pattern) const;
+        Rec findPattern(Frame const& pattern, FeatureContext& ctx) const;
+        Rec findPattern(Pattern const& pattern) const;
+        Rec findPattern(Pattern const& pattern, FeatureContext& ctx) const;
+        /* Extracts the scene's features once and matches every pattern
+         * against them; a pattern with no match gives nullopt. */
+        vector<optional<Rec>> findPatterns(vector<Pattern> const& patterns) const;
+        vector<optional<Rec>> findPatterns(vector<Pattern> const& patterns, FeatureContext& ctx) const;
+        /* Like findPattern but always verified, with the model from the
+         * context's MatchOptions (Homography when it says None). */
+        optional<PatternMatch> locatePattern(Pattern const& pattern) const;
+        optional<PatternMatch> locatePattern(Pattern const& pattern, FeatureContext& ctx) const;
+        /* Pixel search: scores every position on the coarsest pyramid
+         * level of each scale, drops the scales that score clearly worse,
+         * then only refines the best candidates on the way back to full
+         * resolution. Works on the max(R,G,B) grayscale. */
+        vector<TemplateMatch> findTemplate(Frame const& templ,
+            TemplateOptions const& opts = TemplateOptions()) const;
+        vector<TemplateMatch> findTemplate(Template const& templ) const;
+        /* Every pixel-identical occurrence of a sprite, BGRA included, found
+         * with a 2D rolling hash and confirmed with memcmp. The vector
+         * overload makes one pass per distinct sprite size. */
+        vector<Rec> findExact(Frame const& sprite) const;
+        vector<vector<Rec>> findExact(vector<Frame> const& sprites) const;
+        /* Context used by calls that are not given one. Copies and views of
+         * this Frame share it, and a context must not be used by two
+         * threads at once: give each thread its own, or pass one to the
+         * call, when fanning a Frame out to several threads. */
+        void setFeatureContext(shared_ptr<FeatureContext> ctx);
         void crop(Rec const& rec);
+        Frame cropped(Rec const& rec) const;
+        template<class Format>
+        BasicFrame<Format> as() const
+        {
+            BasicFrame<Format> rtv;
+            convertPixels(*m_image, PixelFormat::BGRA8, rtv.m_image, Format::format);
+            return rtv;
+        }
+        FrameView view(Rec const& rec) const;
         bool empty() const;
         void resize(Size const& size);
+        /* data() is only laid out row after row when isContinuous(),
+         * otherwise walk the rows with row() and stride() or compact() */
         uint8_t* data() const;
         uint8_t* data();
+        uint8_t const* row(unsigned r) const;
+        uint8_t* row(unsigned r);
+        size_t stride() const;
+        bool isContinuous() const;
+        void compact();
+        /* bulk versions of get/set, clipped to the frame */
+        void fill(Rec const& rec, Color color, uint8_t v);
+        void fill(Rec const& rec, uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+        void copyFrom(Frame const& src, Rec const& src_rec, Pos const& dst);
+        /* copy one channel to or from an nRows() x nCols() plane */
+        void channel(Color color, uint8_t* dst, size_t dst_stride) const;
+        void setChannel(Color color, uint8_t const* src, size_t src_stride);
+    };
+
+    /* A read-only window onto a Rec of a Frame. It does not own or copy any
+     * pixels, so many views of one Frame are cheap, but a view must not
+     * outlive its Frame nor be used after the Frame is modified. Positions
+     * and Recs are relative to the view's top-left corner. */
+    class FrameView
+    {
+        typedef cv::Mat image_t;
+        friend class PatternTracker;
+    private:
+        image_t m_image;
+        /* the parent Frame's context, so searches behave the same on both */
+        shared_ptr<FeatureContext> m_features;
+        Frame frame() const;
+
+    public:
+        FrameView() = default;
+        FrameView(Frame const& frame, Rec const& rec);
+        uint8_t get(unsigned r, unsigned c, Color color) const;
+        uint8_t const* row(unsigned r) const;
+        size_t stride() const;
+        bool isContinuous() const;
+        unsigned lastCol() const;
+        unsigned lastRow() const;
+        unsigned nCols() const;
+        unsigned nRows() const;
+        Rec frameRec() const;
+        bool empty() const;
+#if !GGFRAME_NO_HIGHGUI
+        void displaySift() const;
+        void displaySiftInRec(Rec const& rec) const;
+#endif
+        Rec findPattern(Frame const& pattern) const;
+        Rec findPattern(Frame const& pattern, FeatureContext& ctx) const;
+        Rec findPattern(Pattern const& pattern) const;
+        Rec findPattern(Pattern const& pattern, FeatureContext& ctx) const;
+        vector<optional<Rec>> findPatterns(vector<Pattern> const& patterns) const;
+        vector<optional<Rec>> findPatterns(vector<Pattern> const& patterns, FeatureContext& ctx) const;
+        optional<PatternMatch> locatePattern(Pattern const& pattern) const;
+        optional<PatternMatch> locatePattern(Pattern const& pattern, FeatureContext& ctx) const;
+        vector<TemplateMatch> findTemplate(Frame const& templ,
+            TemplateOptions const& opts = TemplateOptions()) const;
+        vector<TemplateMatch> findTemplate(Template const& templ) const;
+        vector<Rec> findExact(Frame const& sprite) const;
+        vector<vector<Rec>> findExact(vector<Frame> const& sprites) const;
+    };
+
+    struct TrackerOptions
+    {
+        /* the window is the last Rec grown by this fraction of its size on
+         * every side */
+        float searchMargin = 0.5f;
+        /* a window match below this confidence falls back to a full search */
+        float minConfidence = 0.3f;
+        /* move the window by the sparse optical flow of the last match
+         * before searching it, for patterns that move fast */
+        bool opticalFlow = false;
+    };
+
+    /* Follows one Pattern through consecutive frames. After a match,
+     * update() only extracts features in a window around it, so the cost
+     * depends on the window and not on the frame; the whole frame is only
+     * searched until the pattern is found and whenever the window match
+     * is lost or too weak. Uses its own FeatureContext, so a tracker must
+     * not be updated from two threads at once. */
+    class PatternTracker
+    {
+        Pattern m_pattern;
+        TrackerOptions m_options;
+        shared_ptr<FeatureContext> m_features;
+        optional<PatternMatch> m_last;
+        /* grayscale of the previous frame, for the optical flow */
+        cv::Mat m_prev_gray;
+        Rec m_prev_area;
+        size_t m_full_searches = 0;
+        Rec flowWindow(Frame const& frame) const;
+    public:
+        explicit PatternTracker(Pattern pattern, TrackerOptions const& opts = TrackerOptions());
+        PatternTracker(Pattern pattern, shared_ptr<FeatureContext> ctx,
+            TrackerOptions const& opts = TrackerOptions());
+        optional<PatternMatch> update(Frame const& frame);
+        optional<PatternMatch> const& last() const;
+        /* forget the last match, the next update searches the whole frame */
+        void reset();
+        size_t nFullSearches() const;
+        FeatureContext& featureContext();
+    };
+
+    struct BatchResult
+    {
+        /* position of the frame or path in the list given to run() */
+        size_t index = 0;
+        /* false when the file could not be decoded */
+        bool loaded = true;
+        /* one per pattern, as findPatterns gives them */
+        vector<optional<Rec>> recs;
+    };
+
+    /* Runs findPatterns for one set of Patterns over many frames on a pool
+     * of worker threads, each with its own FeatureContext. Files are
+     * decoded on the workers too. Results go to the callback in completion
+     * order, one call at a time, so the callback needs no locking. run()
+     * returns once every frame is done and rethrows the first exception a
+     * worker hit. */
+    class BatchSearch
+    {
+    public:
+        typedef function<void(BatchResult const&)> Callback;
+    private:
+        vector<Pattern> m_patterns;
+        FeatureOptions m_feature_options;
+        MatchOptions m_match_options;
+        unsigned m_nthreads = 0;
+        void run(size_t n, function<Frame(size_t)> const& frame_at, Callback const& callback) const;
+    public:
+        /* 0 threads uses one per hardware thread */
+        explicit BatchSearch(vector<Pattern> patterns, unsigned nthreads = 0);
+        void setFeatureOptions(FeatureOptions const& options);
+        void setMatchOptions(MatchOptions const& options);
+        unsigned nThreads() const;
+        void run(vector<path> const& paths, Callback const& callback) const;
+        void run(vector<Frame> const& frames, Callback const& callback) const;
+    };
+
+    /* Recycles pixel buffers for capture loops that keep creating Frames of
+     * the same size. Free buffers are grouped by dimensions and format; a
+     * buffer goes back to the pool by itself once the last Frame (or cv::Mat)
+     * using it is gone. Acquired Frames hold whatever pixels were left in the
+     * buffer. The pool must outlive every Frame it hands out. */
+    class FramePool : public cv::MatAllocator
+    {
+        mutable mutex m_mutex;
+        mutable std::map<vector<int>, vector<uchar*>> m_free;
+        mutable size_t m_hits = 0;
+        mutable size_t m_misses = 0;
+    public:
+        FramePool() = default;
+        ~FramePool();
+        FramePool(FramePool const&) = delete;
+        FramePool& operator=(FramePool const&) = delete;
+        Frame acquire(unsigned nrows, unsigned ncols);
+        size_t hits() const;
+        size_t misses() const;
+        size_t nFree() const;
+        void clear();
+
+        UMatData* allocate(int dims, const int* sizes, int type,
+            void* data, size_t* step, AccessFlag flags, UMatUsageFlags usage) const override;
+        bool allocate(UMatData* data, AccessFlag flags, UMatUsageFlags usage) const override;
+        void deallocate(UMatData* data) const override;
+    };
+
+    /* Grabs the screen into Frames without going through an image file.
+     * On X11 the pixels are read through the MIT-SHM extension into a
+     * shared-memory segment, and the grabbed Frame points straight at it:
+     * its contents are only valid until the next grab() and must not outlive
+     * the ScreenCapture. Grabbing a Rec only transfers that region and
+     * copies it into the Frame's own buffer, reusing it when the size
+     * already matches. */
+    class ScreenCapture
+    {
+        struct Impl;
+        unique_ptr<Impl> m_impl;
+    public:
+        ScreenCapture();
+        ScreenCapture(string const& display_name);
+        ~ScreenCapture();
+        ScreenCapture(ScreenCapture const&) = delete;
+        ScreenCapture& operator=(ScreenCapture const&) = delete;
+        unsigned nCols() const;
+        unsigned nRows() const;
+        Rec screenRec() const;
+        void grab(Frame& frame);
+        Frame grab();
+        void grab(Frame& frame, Rec const& rec);
+        Frame grab(Rec const& rec);
     };
 }
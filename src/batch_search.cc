@@ -0,0 +1,101 @@
+#include <ggframe.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+using namespace std;
+using namespace ggframe;
+
+BatchSearch::BatchSearch(vector<Pattern> patterns, unsigned nthreads)
+	: m_patterns(move(patterns))
+	, m_nthreads(nthreads)
+{
+	if (m_nthreads == 0) {
+		m_nthreads = std::max(thread::hardware_concurrency(), 1u);
+	}
+	if (!m_patterns.empty()) {
+		m_feature_options.backend = m_patterns.front().backend();
+	}
+}
+
+void BatchSearch::setFeatureOptions(FeatureOptions const& options)
+{
+	m_feature_options = options;
+}
+
+void BatchSearch::setMatchOptions(MatchOptions const& options)
+{
+	m_match_options = options;
+}
+
+unsigned BatchSearch::nThreads() const
+{
+	return m_nthreads;
+}
+
+void BatchSearch::run(vector<path> const& paths, Callback const& callback) const
+{
+	run(paths.size(), [&](size_t i) {
+		Frame frame;
+		frame.load(paths[i]);
+		return frame;
+	}, callback);
+}
+
+void BatchSearch::run(vector<Frame> const& frames, Callback const& callback) const
+{
+	run(frames.size(), [&](size_t i) {
+		return frames[i];
+	}, callback);
+}
+
+void BatchSearch::run(size_t n, function<Frame(size_t)> const& frame_at, Callback const& callback) const
+{
+	/* frames are independent and taken one at a time from a shared
+	 * cursor, so a worker that is done early just takes the next one */
+	atomic<size_t> next(0);
+	atomic<bool> failed(false);
+	mutex callback_mutex;
+	exception_ptr error;
+	auto work = [&]() {
+		try {
+			FeatureContext ctx(m_feature_options);
+			ctx.setMatchOptions(m_match_options);
+			for (size_t i = next++; i < n && !failed; i = next++) {
+				BatchResult result;
+				result.index = i;
+				Frame frame = frame_at(i);
+				if (frame.empty()) {
+					result.loaded = false;
+					result.recs.resize(m_patterns.size());
+				} else {
+					result.recs = frame.findPatterns(m_patterns, ctx);
+				}
+				lock_guard<mutex> lock(callback_mutex);
+				callback(result);
+			}
+		} catch (...) {
+			lock_guard<mutex> lock(callback_mutex);
+			if (!error) {
+				error = current_exception();
+			}
+			failed = true;
+		}
+	};
+	unsigned nthreads = std::min<size_t>(m_nthreads, n);
+	vector<thread> workers;
+	for (unsigned t = 1; t < nthreads; t++) {
+		workers.emplace_back(work);
+	}
+	/* the calling thread is a worker as well */
+	if (nthreads > 0) {
+		work();
+	}
+	for (thread& worker : workers) {
+		worker.join();
+	}
+	if (error) {
+		rethrow_exception(error);
+	}
+}
@@ -0,0 +1,142 @@
+#include <ggframe.h>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+using namespace ggframe;
+
+namespace {
+
+	/* arithmetic is mod 2^64, both bases odd so no information is lost */
+	typedef uint64_t hash_t;
+	hash_t const row_base = 0x100000001b3ull;
+	hash_t const col_base = 0x9e3779b97f4a7c15ull;
+
+	hash_t power(hash_t base, unsigned exp)
+	{
+		hash_t rtv = 1;
+		for (; exp; exp >>= 1, base *= base) {
+			if (exp & 1) {
+				rtv *= base;
+			}
+		}
+		return rtv;
+	}
+
+	uint32_t pixel(uchar const* row, unsigned c)
+	{
+		/* wrapped frames do not promise 4 byte aligned rows */
+		uint32_t v;
+		memcpy(&v, row + 4 * c, 4);
+		return v;
+	}
+
+	/* hash of every w pixel wide window of a row, out[c] starting at c */
+	void rowHashes(uchar const* row, unsigned ncols, unsigned w, hash_t top, hash_t* out)
+	{
+		hash_t h = 0;
+		for (unsigned c = 0; c < w; c++) {
+			h = h * row_base + pixel(row, c);
+		}
+		out[0] = h;
+		for (unsigned c = w; c < ncols; c++) {
+			h = h * row_base + pixel(row, c) - top * pixel(row, c - w);
+			out[c - w + 1] = h;
+		}
+	}
+
+	hash_t spriteHash(cv::Mat const& sprite)
+	{
+		hash_t rtv = 0;
+		for (int r = 0; r < sprite.rows; r++) {
+			hash_t h;
+			rowHashes(sprite.ptr(r), sprite.cols, sprite.cols, 0, &h);
+			rtv = rtv * col_base + h;
+		}
+		return rtv;
+	}
+
+	bool sameAt(cv::Mat const& scene, int top, int left, cv::Mat const& sprite)
+	{
+		size_t n = sprite.cols * 4;
+		for (int r = 0; r < sprite.rows; r++) {
+			if (memcmp(scene.ptr(top + r, left), sprite.ptr(r), n) != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void search(cv::Mat const& scene, vector<cv::Mat const*> const& sprites,
+		unordered_map<hash_t, vector<size_t>> const& buckets, vector<vector<Rec>>& rtv)
+	{
+		unsigned w = sprites.front()->cols;
+		unsigned h = sprites.front()->rows;
+		unsigned ncand = scene.cols - w + 1;
+		hash_t row_top = power(row_base, w);
+		hash_t col_top = power(col_base, h);
+		/* row hashes of the last h rows, to take the oldest back out */
+		vector<hash_t> ring(size_t(h) * ncand, 0);
+		vector<hash_t> col(ncand, 0);
+		vector<hash_t> fresh(ncand);
+		for (int r = 0; r < scene.rows; r++) {
+			rowHashes(scene.ptr(r), scene.cols, w, row_top, fresh.data());
+			hash_t* old = &ring[size_t(r % h) * ncand];
+			for (unsigned c = 0; c < ncand; c++) {
+				col[c] = col[c] * col_base + fresh[c] - col_top * old[c];
+				old[c] = fresh[c];
+			}
+			if (r + 1 < int(h)) {
+				continue;
+			}
+			int top = r + 1 - h;
+			for (unsigned c = 0; c < ncand; c++) {
+				auto found = buckets.find(col[c]);
+				if (found == buckets.end()) {
+					continue;
+				}
+				for (size_t i : found->second) {
+					if (sameAt(scene, top, c, *sprites[i])) {
+						rtv[i].push_back(Rec::tlbr(top, c, r, c + w - 1));
+					}
+				}
+			}
+		}
+	}
+}
+
+vector<Rec> Frame::findExact(Frame const& sprite) const
+{
+	return findExact(vector<Frame>{ sprite }).front();
+}
+
+vector<vector<Rec>> Frame::findExact(vector<Frame> const& sprites) const
+{
+	vector<vector<Rec>> rtv(sprites.size());
+	if (empty()) {
+		return rtv;
+	}
+	/* one pass per sprite size, identical sprites share a bucket */
+	std::map<pair<int, int>, vector<size_t>> sizes;
+	for (size_t i = 0; i < sprites.size(); i++) {
+		image_t const& sprite = *sprites[i].m_image;
+		if (sprites[i].empty() || sprite.rows > m_image->rows || sprite.cols > m_image->cols) {
+			continue;
+		}
+		sizes[{ sprite.rows, sprite.cols }].push_back(i);
+	}
+	for (auto const& size : sizes) {
+		vector<image_t const*> group;
+		unordered_map<hash_t, vector<size_t>> buckets;
+		vector<vector<Rec>> found(size.second.size());
+		for (size_t i : size.second) {
+			buckets[spriteHash(*sprites[i].m_image)].push_back(group.size());
+			group.push_back(sprites[i].m_image.get());
+		}
+		search(*m_image, group, buckets, found);
+		for (size_t j = 0; j < found.size(); j++) {
+			rtv[size.second[j]] = move(found[j]);
+		}
+	}
+	return rtv;
+}
@@ -0,0 +1,319 @@
+#include <ggframe.h>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/core/hal/hal.hpp>
+#include <opencv2/xfeatures2d/nonfree.hpp>
+#if !GGFRAME_NO_HIGHGUI
+#include <opencv2/highgui.hpp>
+#endif
+
+#include "simd.h"
+
+using namespace std;
+using namespace ggframe;
+using namespace cv::xfeatures2d;
+
+namespace {
+
+	/* squared L2 distance between two float descriptors */
+#if GGFRAME_X86
+	GGFRAME_TARGET_AVX2
+	float l2SqrAvx2(float const* a, float const* b, int n)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(d, d));
+		}
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		sum = _mm_hadd_ps(sum, sum);
+		sum = _mm_hadd_ps(sum, sum);
+		float rtv = _mm_cvtss_f32(sum);
+		for (; i < n; i++) {
+			rtv += (a[i] - b[i]) * (a[i] - b[i]);
+		}
+		return rtv;
+	}
+#endif
+
+	float l2Sqr(float const* a, float const* b, int n)
+	{
+#if GGFRAME_X86
+		static bool const has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+		if (has_avx2) {
+			return l2SqrAvx2(a, b, n);
+		}
+#endif
+		int i = 0;
+		float rtv = 0;
+#if GGFRAME_NEON
+		float32x4_t acc = vdupq_n_f32(0);
+		for (; i + 4 <= n; i += 4) {
+			float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+			acc = vmlaq_f32(acc, d, d);
+		}
+		float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+		rtv = vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+		for (; i < n; i++) {
+			rtv += (a[i] - b[i]) * (a[i] - b[i]);
+		}
+		return rtv;
+	}
+
+#if GGFRAME_X86
+	/* bits set in a ^ b, counted a nibble at a time with a shuffle table */
+	GGFRAME_TARGET_AVX2
+	int hammingAvx2(uint8_t const* a, uint8_t const* b, int n)
+	{
+		__m256i const table = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		__m256i const low_nibble = _mm256_set1_epi8(0x0f);
+		__m256i acc = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 32 <= n; i += 32) {
+			__m256i x = _mm256_xor_si256(
+				_mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i)),
+				_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i)));
+			__m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(x, low_nibble));
+			__m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibble));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+		}
+		int rtv = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+			+ _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+		if (i < n) {
+			rtv += cv::hal::normHamming(a + i, b + i, n - i);
+		}
+		return rtv;
+	}
+#endif
+
+	int hamming(uint8_t const* a, uint8_t const* b, int n)
+	{
+#if GGFRAME_X86
+		static bool const has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+		if (has_avx2) {
+			return hammingAvx2(a, b, n);
+		}
+#endif
+		/* OpenCV's own popcount, SSE/NEON where available */
+		return cv::hal::normHamming(a, b, n);
+	}
+
+	/* Exact nearest neighbour of every query row, keeping the runner-up
+	 * for the ratio test instead of sorting a full distance row. Float
+	 * descriptors compare squared L2 distances, binary ones Hamming. */
+	template<class T, class Distance>
+	void simdMatch(cv::Mat const& query, cv::Mat const& train, float ratio,
+		Distance distance, bool squared, vector<DMatch>& matches)
+	{
+		int dims = query.cols;
+		float limit = squared ? ratio * ratio : ratio;
+		for (int q = 0; q < query.rows; q++) {
+			T const* qd = query.ptr<T>(q);
+			float best = numeric_limits<float>::max();
+			float second = best;
+			int best_idx = -1;
+			for (int t = 0; t < train.rows; t++) {
+				float d = distance(qd, train.ptr<T>(t), dims);
+				if (d < best) {
+					second = best;
+					best = d;
+					best_idx = t;
+				} else if (d < second) {
+					second = d;
+				}
+			}
+			if (best_idx < 0 || (ratio > 0 && best >= limit * second)) {
+				continue;
+			}
+			matches.emplace_back(q, best_idx, squared ? sqrt(best) : best);
+		}
+	}
+}
+
+FeatureContext::FeatureContext()
+	: FeatureContext(FeatureOptions())
+{
+}
+
+FeatureContext::FeatureContext(FeatureOptions const& options)
+{
+	setFeatureOptions(options);
+}
+
+void FeatureContext::setFeatureOptions(FeatureOptions const& options)
+{
+	m_feature_options = options;
+	float acc = min(max(options.accuracy, 0.0f), 1.0f);
+	bool binary = true;
+	switch (options.backend) {
+	case FeatureBackend::Sift:
+		m_detector = SIFT::create(0, 3, 0.07 - 0.06 * acc);
+		binary = false;
+		break;
+	case FeatureBackend::Orb:
+		/* a 19 px patch instead of the default 31 px one, so that sprites
+		 * barely bigger than that still keep keypoints on every level */
+		m_detector = cv::ORB::create(100 + 800 * acc, 1.2f, 4 + 8 * acc, 19, 0, 2,
+			cv::ORB::HARRIS_SCORE, 19);
+		break;
+	case FeatureBackend::Akaze:
+		m_detector = cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB, 0, 3,
+			0.001f * pow(4.0f, 1 - 2 * acc));
+		break;
+	case FeatureBackend::Brisk:
+		m_detector = cv::BRISK::create(50 - 40 * acc, 1 + 4 * acc);
+		break;
+	}
+	if (binary) {
+		m_matcher = cv::makePtr<cv::BFMatcher>(cv::NORM_HAMMING);
+		m_flann = cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(12, 20, 2));
+	} else {
+		m_matcher = cv::makePtr<cv::BFMatcher>(cv::NORM_L2);
+		m_flann = cv::makePtr<cv::FlannBasedMatcher>();
+	}
+	newScene();
+}
+
+FeatureOptions const& FeatureContext::featureOptions() const
+{
+	return m_feature_options;
+}
+
+FeatureContext& FeatureContext::threadDefault()
+{
+	thread_local FeatureContext ctx;
+	return ctx;
+}
+
+void FeatureContext::detect(cv::Mat const& gray, Rec const& rec, vector<KeyPoint>& kps)
+{
+	Rec bounds = Rec::tlbr(0, 0, gray.rows - 1, gray.cols - 1);
+	Rec clipped = rec.intersect(bounds);
+	if (clipped.empty()) {
+		kps.clear();
+		return;
+	}
+	/* detect on the Rec plus a margin, so that keypoints near its edges
+	 * still see their neighbourhood, and mask off the margin itself */
+	Rec window = Rec::tlbr(
+		clipped.top() - roi_margin, clipped.left() - roi_margin,
+		clipped.bottom() + roi_margin, clipped.right() + roi_margin
+	).intersect(bounds);
+	cv::Mat sub = gray(cv::Rect(window.left(), window.top(), window.width(), window.height()));
+	if (window.width() == clipped.width() && window.height() == clipped.height()) {
+		m_detector->detect(sub, kps);
+	} else {
+		/* create() keeps the buffer when the size has not changed */
+		m_mask.create(sub.rows, sub.cols, CV_8U);
+		m_mask.setTo(0);
+		m_mask(cv::Rect(clipped.left() - window.left(), clipped.top() - window.top(),
+			clipped.width(), clipped.height())).setTo(1);
+		m_detector->detect(sub, kps, m_mask);
+	}
+	for (KeyPoint& kp : kps) {
+		kp.pt.x += window.left();
+		kp.pt.y += window.top();
+	}
+}
+
+void FeatureContext::detectAndCompute(cv::Mat const& gray, vector<KeyPoint>& kps, cv::Mat& desc,
+	cv::InputArray mask)
+{
+	m_detector->detectAndCompute(gray, mask, kps, desc);
+	if (m_debug_hook) {
+		m_debug_hook(gray, kps);
+	}
+}
+
+void FeatureContext::setMatchOptions(MatchOptions const& options)
+{
+	m_match_options = options;
+}
+
+MatchOptions const& FeatureContext::matchOptions() const
+{
+	return m_match_options;
+}
+
+MatchStrategy FeatureContext::sceneStrategy(cv::Mat const& query) const
+{
+	MatchStrategy strategy = m_match_options.strategy;
+	if (strategy == MatchStrategy::Auto) {
+		size_t pairs = size_t(query.rows) * m_scene_desc.rows;
+		strategy = pairs <= m_match_options.maxBruteForcePairs
+			? MatchStrategy::SimdBruteForce : MatchStrategy::Flann;
+	}
+	return strategy;
+}
+
+void FeatureContext::newScene()
+{
+	/* the FLANN index over m_scene_desc is built by the first query that
+	 * needs it and then shared by every pattern matched on this scene */
+	m_flann->clear();
+	m_flann_trained = false;
+}
+
+void FeatureContext::matchScene(cv::Mat const& query, vector<DMatch>& matches)
+{
+	matches.clear();
+	if (query.empty() || m_scene_desc.empty()) {
+		return;
+	}
+	MatchStrategy strategy = sceneStrategy(query);
+	float ratio = m_match_options.ratio;
+	if (strategy == MatchStrategy::SimdBruteForce) {
+		if (query.depth() == CV_8U) {
+			simdMatch<uint8_t>(query, m_scene_desc, ratio, hamming, false, matches);
+		} else {
+			simdMatch<float>(query, m_scene_desc, ratio, l2Sqr, true, matches);
+		}
+		return;
+	}
+	bool flann = strategy == MatchStrategy::Flann;
+	if (flann && !m_flann_trained) {
+		m_flann->add(m_scene_desc);
+		m_flann->train();
+		m_flann_trained = true;
+	}
+	if (ratio <= 0) {
+		if (flann) {
+			m_flann->match(query, matches);
+		} else {
+			m_matcher->match(query, m_scene_desc, matches);
+		}
+		return;
+	}
+	if (flann) {
+		m_flann->knnMatch(query, m_knn, 2);
+	} else {
+		m_matcher->knnMatch(query, m_scene_desc, m_knn, 2);
+	}
+	for (vector<DMatch> const& best : m_knn) {
+		if (best.size() == 1 || (best.size() == 2 && best[0].distance < ratio * best[1].distance)) {
+			matches.push_back(best[0]);
+		}
+	}
+}
+
+void FeatureContext::setDebugHook(DebugHook hook)
+{
+	m_debug_hook = move(hook);
+}
+
+#if !GGFRAME_NO_HIGHGUI
+FeatureContext::DebugHook FeatureContext::displayHook()
+{
+	return [](cv::Mat const& gray, vector<KeyPoint> const& keypoints) {
+		cv::Mat mat_keypts;
+		cv::drawKeypoints(gray, keypoints, mat_keypts);
+		cv::imshow("img keypoints", mat_keypts);
+		cv::waitKey(0);
+	};
+}
+#endif
@@ -0,0 +1,115 @@
+#include <ggframe.h>
+
+using namespace std;
+using namespace ggframe;
+
+FramePool::~FramePool()
+{
+	clear();
+}
+
+Frame FramePool::acquire(unsigned nrows, unsigned ncols)
+{
+	Frame frame;
+	frame.m_image->allocator = this;
+	frame.m_image->create(nrows, ncols, CV_8UC4);
+	return frame;
+}
+
+size_t FramePool::hits() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_hits;
+}
+
+size_t FramePool::misses() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_misses;
+}
+
+size_t FramePool::nFree() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	size_t n = 0;
+	for (auto const& bucket : m_free) {
+		n += bucket.second.size();
+	}
+	return n;
+}
+
+void FramePool::clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	/* buckets stay, outstanding buffers point at them through userdata */
+	for (auto& bucket : m_free) {
+		for (uchar* data : bucket.second) {
+			cv::fastFree(data);
+		}
+		bucket.second.clear();
+	}
+}
+
+UMatData* FramePool::allocate(int dims, const int* sizes, int type,
+	void* data0, size_t* step, AccessFlag, UMatUsageFlags) const
+{
+	/* same layout rules as OpenCV's default allocator */
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--) {
+		if (step) {
+			if (data0 && step[i] != cv::Mat::AUTO_STEP) {
+				CV_Assert(total <= step[i]);
+				total = step[i];
+			} else {
+				step[i] = total;
+			}
+		}
+		total *= sizes[i];
+	}
+	UMatData* u = new UMatData(this);
+	u->size = total;
+	if (data0) {
+		u->data = u->origdata = static_cast<uchar*>(data0);
+		u->flags |= UMatData::USER_ALLOCATED;
+		return u;
+	}
+	vector<int> key(sizes, sizes + dims);
+	key.push_back(type);
+	uchar* data = nullptr;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		vector<uchar*>& bucket = m_free[key];
+		if (bucket.empty()) {
+			m_misses++;
+		} else {
+			m_hits++;
+			data = bucket.back();
+			bucket.pop_back();
+		}
+		u->userdata = &bucket;
+	}
+	if (!data) {
+		data = static_cast<uchar*>(cv::fastMalloc(total));
+	}
+	u->data = u->origdata = data;
+	return u;
+}
+
+bool FramePool::allocate(UMatData* u, AccessFlag, UMatUsageFlags) const
+{
+	return u != nullptr;
+}
+
+void FramePool::deallocate(UMatData* u) const
+{
+	if (!u) {
+		return;
+	}
+	CV_Assert(u->urefcount == 0);
+	CV_Assert(u->refcount == 0);
+	if (!(u->flags & UMatData::USER_ALLOCATED)) {
+		lock_guard<mutex> lock(m_mutex);
+		static_cast<vector<uchar*>*>(u->userdata)->push_back(u->origdata);
+	}
+	delete u;
+}
@@ -0,0 +1,155 @@
+#include <ggframe.h>
+
+using namespace std;
+using namespace ggframe;
+
+FrameView::FrameView(Frame const& frame, Rec const& rec)
+{
+	m_features = frame.m_features;
+	Rec clipped = rec.intersect(frame.frameRec());
+	if (frame.empty() || clipped.empty()) {
+		return;
+	}
+	image_t const& image = *frame.m_image;
+	/* a header built from a raw pointer does not touch the refcount */
+	m_image = image_t(
+		clipped.height(), clipped.width(), image.type(),
+		const_cast<uchar*>(image.ptr(clipped.top(), clipped.left())), image.step
+	);
+}
+
+FrameView Frame::view(Rec const& rec) const
+{
+	return FrameView(*this, rec);
+}
+
+Frame FrameView::frame() const
+{
+	/* borrows the view's pixels, only ever used through const methods */
+	Frame rtv;
+	rtv.m_image = make_shared<image_t>(m_image);
+	rtv.m_features = m_features;
+	return rtv;
+}
+
+uint8_t FrameView::get(unsigned r, unsigned c, Color color) const
+{
+	return m_image.at<cv::Vec4b>(r,c)[Frame::colorIndex(color)];
+}
+
+uint8_t const* FrameView::row(unsigned r) const
+{
+	return m_image.ptr(r);
+}
+
+size_t FrameView::stride() const
+{
+	return m_image.step;
+}
+
+bool FrameView::isContinuous() const
+{
+	return m_image.isContinuous();
+}
+
+unsigned FrameView::lastCol() const
+{
+	return nCols() > 0 ? nCols() - 1 : 0;
+}
+
+unsigned FrameView::lastRow() const
+{
+	return nRows() > 0 ? nRows() - 1 : 0;
+}
+
+unsigned FrameView::nCols() const
+{
+	return m_image.cols;
+}
+
+unsigned FrameView::nRows() const
+{
+	return m_image.rows;
+}
+
+Rec FrameView::frameRec() const
+{
+	return Rec::tlbr(0,0,lastRow(),lastCol());
+}
+
+bool FrameView::empty() const
+{
+	return nRows() == 0 || nCols() == 0;
+}
+
+#if !GGFRAME_NO_HIGHGUI
+void FrameView::displaySift() const
+{
+	frame().displaySift();
+}
+
+void FrameView::displaySiftInRec(Rec const& rec) const
+{
+	frame().displaySiftInRec(rec);
+}
+#endif
+
+Rec FrameView::findPattern(Frame const& pattern) const
+{
+	return frame().findPattern(pattern);
+}
+
+Rec FrameView::findPattern(Frame const& pattern, FeatureContext& ctx) const
+{
+	return frame().findPattern(pattern, ctx);
+}
+
+Rec FrameView::findPattern(Pattern const& pattern) const
+{
+	return frame().findPattern(pattern);
+}
+
+Rec FrameView::findPattern(Pattern const& pattern, FeatureContext& ctx) const
+{
+	return frame().findPattern(pattern, ctx);
+}
+
+vector<optional<Rec>> FrameView::findPatterns(vector<Pattern> const& patterns) const
+{
+	return frame().findPatterns(patterns);
+}
+
+vector<optional<Rec>> FrameView::findPatterns(vector<Pattern> const& patterns, FeatureContext& ctx) const
+{
+	return frame().findPatterns(patterns, ctx);
+}
+
+optional<PatternMatch> FrameView::locatePattern(Pattern const& pattern) const
+{
+	return frame().locatePattern(pattern);
+}
+
+optional<PatternMatch> FrameView::locatePattern(Pattern const& pattern, FeatureContext& ctx) const
+{
+	return frame().locatePattern(pattern, ctx);
+}
+
+vector<TemplateMatch> FrameView::findTemplate(Frame const& templ, TemplateOptions const& opts) const
+{
+	return frame().findTemplate(templ, opts);
+}
+
+vector<TemplateMatch> FrameView::findTemplate(Template const& templ) const
+{
+	return frame().findTemplate(templ);
+}
+
+vector<Rec> FrameView::findExact(Frame const& sprite) const
+{
+	return frame().findExact(sprite);
+}
+
+vector<vector<Rec>> FrameView::findExact(vector<Frame> const& sprites) const
+{
+	return frame().findExact(sprites);
+}
@@ -2,9 +2,14 @@
 #include <iostream>
 
 #include <opencv2/xfeatures2d/nonfree.hpp>
-#include <opencv2/highgui.hpp>
 #include <opencv2/features2d/features2d.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
+#if !GGFRAME_NO_HIGHGUI
+#include <opencv2/highgui.hpp>
+#endif
+
+#include "simd.h"
 
 using namespace std;
 using namespace ggframe;
@@ -20,22 +25,135 @@ using ggframe::Size;
 
 Frame::Frame()
 {
-	m_image = make_unique<image_t>();
+	m_image = make_shared<image_t>();
 	assert(nCols() == 0);
 	assert(nRows() == 0);
 }
 
 Frame::Frame(unsigned nrows, unsigned ncols)
 {
-	m_image = make_unique<image_t>(nrows, ncols, CV_8UC4, 0);
+	m_image = make_shared<image_t>(nrows, ncols, CV_8UC4, 0);
 }
 
 Frame::Frame(path filepath)
 {
-	m_image = make_unique<image_t>();
+	m_image = make_shared<image_t>();
 	load(filepath);
 }
 
+namespace {
+
+	cv::Rect toCvRect(Rec const& rec)
+	{
+		return cv::Rect(rec.left(), rec.top(), rec.width(), rec.height());
+	}
+
+	/* The grayscale used for feature detection is max(R,G,B) per pixel.
+	 * Picks AVX2 at runtime on x86 and NEON on ARM, and falls back to
+	 * scalar code for the tail and everywhere else. */
+#if GGFRAME_X86
+	GGFRAME_TARGET_AVX2
+	size_t maxRGBAvx2(uint8_t const* px, uint8_t* out, size_t n)
+	{
+		/* each 32 bit lane holds B,G,R,A: fold G and R onto B, then pack
+		 * the low bytes of four vectors into 32 output pixels */
+		__m256i const low_byte = _mm256_set1_epi32(0xff);
+		__m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		size_t c = 0;
+		for (; c + 32 <= n; c += 32) {
+			__m256i v[4];
+			for (int i = 0; i < 4; i++) {
+				__m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(px + 4 * c + 32 * i));
+				p = _mm256_max_epu8(p, _mm256_max_epu8(_mm256_srli_epi32(p, 8), _mm256_srli_epi32(p, 16)));
+				v[i] = _mm256_and_si256(p, low_byte);
+			}
+			__m256i packed = _mm256_packus_epi16(
+				_mm256_packus_epi32(v[0], v[1]), _mm256_packus_epi32(v[2], v[3]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + c),
+				_mm256_permutevar8x32_epi32(packed, order));
+		}
+		return c;
+	}
+#endif
+
+	void maxRGB(uint8_t const* px, uint8_t* out, size_t n)
+	{
+		size_t c = 0;
+#if GGFRAME_X86
+		static bool const has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+		if (has_avx2) {
+			c = maxRGBAvx2(px, out, n);
+		}
+#elif GGFRAME_NEON
+		for (; c + 16 <= n; c += 16) {
+			uint8x16x4_t p = vld4q_u8(px + 4 * c);
+			vst1q_u8(out + c, vmaxq_u8(vmaxq_u8(p.val[0], p.val[1]), p.val[2]));
+		}
+#endif
+		for (; c < n; c++) {
+			uint8_t const* p = px + 4 * c;
+			out[c] = max(max(p[0], p[1]), p[2]);
+		}
+	}
+
+	/* Hands ownership of a wrapped buffer to OpenCV's refcount, so that
+	 * every Mat header sharing it (crops included) keeps it alive. */
+	class WrappedAllocator : public cv::MatAllocator
+	{
+	public:
+		UMatData* allocate(int, const int*, int, void*, size_t*, AccessFlag, UMatUsageFlags) const override
+		{
+			CV_Error(cv::Error::StsNotImplemented, "wrapped buffers are never allocated");
+		}
+
+		bool allocate(UMatData* u, AccessFlag, UMatUsageFlags) const override
+		{
+			return u != nullptr;
+		}
+
+		void deallocate(UMatData* u) const override
+		{
+			if (!u) {
+				return;
+			}
+			auto deleter = static_cast<function<void(uint8_t*)>*>(u->userdata);
+			(*deleter)(u->origdata);
+			delete deleter;
+			delete u;
+		}
+	};
+
+	WrappedAllocator wrapped_allocator;
+}
+
+Frame Frame::wrap(uint8_t* data, unsigned nrows, unsigned ncols,
+	size_t stride, PixelFormat format, function<void(uint8_t*)> deleter)
+{
+	Frame rtv;
+	if (format != PixelFormat::BGRA8) {
+		int type = format == PixelFormat::BGR8 ? CV_8UC3 : CV_8UC1;
+		convertPixels(image_t(nrows, ncols, type, data, stride), format, *rtv.m_image, PixelFormat::BGRA8);
+		if (deleter) {
+			deleter(data);
+		}
+		return rtv;
+	}
+	image_t& image = *rtv.m_image;
+	image = image_t(nrows, ncols, CV_8UC4, data, stride);
+	if (deleter) {
+		UMatData* u = new UMatData(&wrapped_allocator);
+		u->data = u->origdata = data;
+		u->size = image.step * nrows;
+		u->flags |= UMatData::USER_ALLOCATED;
+		u->userdata = new function<void(uint8_t*)>(move(deleter));
+		image.u = u;
+		image.allocator = &wrapped_allocator;
+		image.addref();
+	}
+	return rtv;
+}
+
+#if !GGFRAME_NO_HIGHGUI
 void Frame::display() const
 {
 	static string window_title = "";
@@ -46,26 +164,24 @@ void Frame::display() const
 	cv::imshow("ggframe", *m_image);
 	cv::waitKey(1);
 }
+#endif
 
-unsigned Frame::colorIndex(Color color) const
+unsigned Frame::colorIndex(Color color)
 {
-	if (color == Color::A) {
-		return 3;
-	}
-	if (color == Color::R) {
-		return 2;
-	}
-	if (color == Color::G) {
-		return 1;
-	}
-	if (color == Color::B) {
-		return 0;
+	return BGRA8::offset(color);
+}
+
+void Frame::detach()
+{
+	m_gray.reset();
+	if (m_image.use_count() > 1) {
+		m_image = make_shared<image_t>(m_image->clone());
 	}
-	return 0;
 }
 
 void Frame::set(unsigned r, unsigned c, Color color, uint8_t v)
 {
+	detach();
 	cv::Vec4b& vec = m_image->at<cv::Vec4b>(r,c);
 	vec[colorIndex(color)] = v;
 }
@@ -82,9 +198,22 @@ void Frame::save(path path)
 
 void Frame::load(path path)
 {
-	*m_image = cv::imread(path.string().c_str());
+	/* keep the file's alpha, everything else in Frame assumes BGRA */
+	image_t image = cv::imread(path.string().c_str(), cv::IMREAD_UNCHANGED);
+	if (image.depth() != CV_8U) {
+		image.convertTo(image, CV_8U, image.depth() == CV_16U ? 1.0 / 256 : 1.0);
+	}
+	m_image = make_shared<image_t>();
+	if (image.channels() == 4 || image.empty()) {
+		*m_image = image;
+	} else {
+		convertPixels(image, image.channels() == 3 ? PixelFormat::BGR8 : PixelFormat::Gray8,
+			*m_image, PixelFormat::BGRA8);
+	}
+	m_gray.reset();
 }
 
+#if !GGFRAME_NO_HIGHGUI
 InputEvent Frame::waitForInput()
 {
 	struct CV_SetMouseCallBack_UserData_Wrapper {
@@ -105,16 +234,22 @@ InputEvent Frame::waitForInput()
 	}
 	return userdata_wrapper.input_event;
 }
+#endif
 
 void Frame::drawGrid()
 {
-	for (int r = 0; r < nRows(); r++) {
-		for (int c = 0; c < nCols(); c++) {
-			if (r % m_grid_size == 0 || c % m_grid_size == 0) {
-				set(r, c, Color::R, min(get(r, c, Color::R) + 25, 255));
-				set(r, c, Color::B, min(get(r, c, Color::B) + 25, 255));
-				set(r, c, Color::G, min(get(r, c, Color::G) + 25, 255));
-			}
+	detach();
+	auto brighten = [](uint8_t* px) {
+		px[0] = min(px[0] + 25, 255);
+		px[1] = min(px[1] + 25, 255);
+		px[2] = min(px[2] + 25, 255);
+	};
+	for (unsigned r = 0; r < nRows(); r++) {
+		uint8_t* px = m_image->ptr(r);
+		/* grid rows are lit across, other rows only on grid columns */
+		unsigned step = r % m_grid_size == 0 ? 1 : m_grid_size;
+		for (unsigned c = 0; c < nCols(); c += step) {
+			brighten(px + 4 * c);
 		}
 	}
 }
@@ -182,6 +317,7 @@ ggframe::Size ggframe::Size::hw(int h, int w)
 
 void Frame::drawRec(Rec const& rec)
 {
+	detach();
     cv::rectangle(*m_image, cv::Point(rec.left(), rec.top()), cv::Point(rec.right(), rec.bottom()), cv::Scalar(0,0,255));
 }
 
@@ -205,6 +341,7 @@ unsigned Frame::nRows() const
 	return m_image->rows;
 }
 
+#if !GGFRAME_NO_HIGHGUI
 void Frame::displaySift() const
 {
 	return displaySiftInRec(frameRec());
@@ -212,16 +349,7 @@ void Frame::displaySift() const
 
 void Frame::showKeyPoints(vector<KeyPoint> const& keypoints) const
 {
-	Mat mat(nRows(), nCols(), CV_8U);
-	for (int r = 0; r < nRows(); r++) {
-		for (int c = 0; c < nCols(); c++) {
-			uint8_t v = 0;
-			v = max(v, get(r, c, Color::R));
-			v = max(v, get(r, c, Color::B));
-			v = max(v, get(r, c, Color::G));
-			mat.at<uint8_t>(r, c) = v;
-		}
-	}
+	Mat mat = cvMat();
 	Mat mat_keypts;
 	drawKeypoints(mat, keypoints, mat_keypts);
 	cv::imshow("img keypoints", mat_keypts);
@@ -233,36 +361,57 @@ void Frame::displaySiftInRec(Rec const& rec) const
 	vector<KeyPoint> kps = getSiftKeyPointsInRec(rec);
 	showKeyPoints(kps);
 }
+#endif
 
 vector<KeyPoint> Frame::getSiftKeyPointsInRec(Rec const& rec) const
 {
-	shared_ptr<SIFT> sift = SIFT::create();
-	Mat mat(nRows(), nCols(), CV_8U);
-	Mat mask(nRows(), nCols(), CV_8U);
-	for (int r = 0; r < nRows(); r++) {
-		for (int c = 0; c < nCols(); c++) {
-			uint8_t v = 0;
-			v = max(v, get(r, c, Color::R));
-			v = max(v, get(r, c, Color::B));
-			v = max(v, get(r, c, Color::G));
-			mat.at<uint8_t>(r, c) = v;
-			if (rec.left() <= c && c <= rec.right()
-				&& rec.top() <= r && r <= rec.bottom()) 
-			{
-				mask.at<uint8_t>(r, c) = 1;
-			} else {
-				mask.at<uint8_t>(r, c) = 0;
-			}
-		}
-	}
+	return getSiftKeyPointsInRec(rec, featureContext());
+}
+
+vector<KeyPoint> Frame::getSiftKeyPointsInRec(Rec const& rec, FeatureContext& ctx) const
+{
 	vector<KeyPoint> keypoints;
-	sift->detect(mat, keypoints, mask);
+	if (atomic_load(&m_gray) || empty()) {
+		ctx.detect(cvMat(), rec, keypoints);
+		return keypoints;
+	}
+	/* no grayscale yet: convert only the Rec and the margin detect() looks
+	 * at, instead of the whole frame */
+	int margin = FeatureContext::roi_margin;
+	Rec window = Rec::tlbr(
+		rec.top() - margin, rec.left() - margin, rec.bottom() + margin, rec.right() + margin
+	).intersect(frameRec());
+	if (window.empty()) {
+		return keypoints;
+	}
+	image_t gray(window.height(), window.width(), CV_8U);
+	for (int r = 0; r < gray.rows; r++) {
+		maxRGB(m_image->ptr(window.top() + r, window.left()), gray.ptr(r), gray.cols);
+	}
+	Rec local = Rec::tlbr(rec.top() - window.top(), rec.left() - window.left(),
+		rec.bottom() - window.top(), rec.right() - window.left());
+	ctx.detect(gray, local, keypoints);
+	for (KeyPoint& kp : keypoints) {
+		kp.pt.x += window.left();
+		kp.pt.y += window.top();
+	}
 	return keypoints;
 }
 
+FeatureContext& Frame::featureContext() const
+{
+	return m_features ? *m_features : FeatureContext::threadDefault();
+}
+
+void Frame::setFeatureContext(shared_ptr<FeatureContext> ctx)
+{
+	m_features = move(ctx);
+}
+
 bool Rec::empty() const
 {
-	return m_h == 0 || m_h == 0;
+	/* a default Rec has all edges at 0 but no size */
+	return m_w == 0 || m_h == 0 || right() < left() || bottom() < top();
 }
 
 bool Frame::empty() const
@@ -272,45 +421,114 @@ bool Frame::empty() const
 
 cv::Mat Frame::cvMat() const
 {
-	Mat mat(nRows(), nCols(), CV_8U);
-	for (int r = 0; r < nRows(); r++) {
-		for (int c = 0; c < nCols(); c++) {
-			uint8_t v = 0;
-			v = max(v, get(r, c, Color::R));
-			v = max(v, get(r, c, Color::B));
-			v = max(v, get(r, c, Color::G));
-			mat.at<uint8_t>(r, c) = v;
+	/* const Frames may be read from several threads at once */
+	shared_ptr<image_t const> gray = atomic_load(&m_gray);
+	if (!gray) {
+		auto fresh = make_shared<image_t>(nRows(), nCols(), CV_8U);
+		for (unsigned r = 0; r < nRows(); r++) {
+			maxRGB(m_image->ptr(r), fresh->ptr(r), nCols());
 		}
+		gray = fresh;
+		atomic_store(&m_gray, gray);
 	}
-	return mat;
+	return *gray;
 }
 
 Rec Frame::findPattern(Frame const& pattern) const
 {
-	auto sift = SIFT::create();
-	vector<KeyPoint> self_kps = getSiftKeyPointsInRec(frameRec());
-	vector<KeyPoint> pattern_kps = pattern.getSiftKeyPointsInRec(pattern.frameRec());
-	cv::Mat self_mat = cvMat();
-	cv::Mat pattern_mat = pattern.cvMat();
-	cv::Mat self_desc;
-	cv::Mat pattern_desc;
-	sift->compute(self_mat, self_kps, self_desc);
-	sift->compute(pattern_mat, pattern_kps, pattern_desc);
-
-	pattern.displaySift();
-	displaySift();
-
-	cv::BFMatcher bforce;
-	vector<cv::DMatch> matches;
-	bforce.add(self_desc);
-	bforce.match(pattern_desc, matches);
+	return findPattern(pattern, featureContext());
+}
+
+Rec Frame::findPattern(Frame const& pattern, FeatureContext& ctx) const
+{
+	/* the context's scratch Pattern keeps its buffers between calls */
+	ctx.m_pattern.compute(pattern, ctx);
+	return findPattern(ctx.m_pattern, ctx);
+}
+
+Rec Frame::findPattern(Pattern const& pattern) const
+{
+	return findPattern(pattern, featureContext());
+}
+
+Rec Frame::findPattern(Pattern const& pattern, FeatureContext& ctx) const
+{
+	extractScene(ctx);
+	matchPattern(pattern, ctx);
+	if (ctx.matchOptions().verification == Verification::None) {
+		return matchedRec(ctx);
+	}
+	/* an unverified pattern gives an empty Rec */
+	return patternRec(pattern, ctx).value_or(Rec::tlbr(0, 0, -1, -1));
+}
+
+vector<optional<Rec>> Frame::findPatterns(vector<Pattern> const& patterns) const
+{
+	return findPatterns(patterns, featureContext());
+}
+
+vector<optional<Rec>> Frame::findPatterns(vector<Pattern> const& patterns, FeatureContext& ctx) const
+{
+	vector<optional<Rec>> rtv;
+	rtv.reserve(patterns.size());
+	extractScene(ctx);
+	for (Pattern const& pattern : patterns) {
+		matchPattern(pattern, ctx);
+		rtv.push_back(patternRec(pattern, ctx));
+	}
+	return rtv;
+}
+
+optional<Rec> Frame::patternRec(Pattern const& pattern, FeatureContext const& ctx) const
+{
+	if (ctx.matchOptions().verification != Verification::None) {
+		optional<PatternMatch> verified = verifiedMatch(pattern, ctx);
+		if (!verified) {
+			return nullopt;
+		}
+		return verified->rec;
+	}
+	if (ctx.m_matches.empty()) {
+		return nullopt;
+	}
+	return matchedRec(ctx);
+}
+
+void Frame::extractScene(FeatureContext& ctx) const
+{
+	ctx.detectAndCompute(cvMat(), ctx.m_scene_kps, ctx.m_scene_desc);
+	ctx.newScene();
+}
+
+void Frame::extractScene(FeatureContext& ctx, Rec const& rec) const
+{
+	Rec clipped = rec.intersect(frameRec());
+	/* create() keeps the buffer when the size has not changed */
+	ctx.m_mask.create(nRows(), nCols(), CV_8U);
+	ctx.m_mask.setTo(0);
+	if (!empty() && !clipped.empty()) {
+		ctx.m_mask(toCvRect(clipped)).setTo(255);
+	}
+	ctx.detectAndCompute(cvMat(), ctx.m_scene_kps, ctx.m_scene_desc, ctx.m_mask);
+	ctx.newScene();
+}
+
+void Frame::matchPattern(Pattern const& pattern, FeatureContext& ctx) const
+{
+	/* descriptors from different backends cannot be compared */
+	CV_Assert(pattern.backend() == ctx.featureOptions().backend);
+	ctx.matchScene(pattern.m_descriptors, ctx.m_matches);
+}
+
+Rec Frame::matchedRec(FeatureContext const& ctx) const
+{
+	vector<KeyPoint> const& self_kps = ctx.m_scene_kps;
 	unsigned min_t = -1;
 	unsigned max_b = 0;
 	unsigned min_l = -1;
 	unsigned max_r = 0;
-	for (cv::DMatch& m : matches) {
-		KeyPoint& pattern_kp = pattern_kps[m.queryIdx];
-		KeyPoint& self_kp = self_kps[m.trainIdx];
+	for (cv::DMatch const& m : ctx.m_matches) {
+		KeyPoint const& self_kp = self_kps[m.trainIdx];
 		unsigned frame_col = self_kp.pt.x;
 		unsigned frame_row = self_kp.pt.y;
 		min_t = min(frame_row, min_t);
@@ -351,20 +569,65 @@ Rec Rec::intersect(Rec const& other) const
 Frame::Frame(Frame const& other)
 {
 	m_grid_size = other.m_grid_size;
-	m_image = make_unique<image_t>(*other.m_image);
+	m_image = other.m_image;
+	m_gray = atomic_load(&other.m_gray);
+	m_features = other.m_features;
+}
+
+Frame::Frame(Frame&& other) noexcept
+{
+	*this = move(other);
+}
+
+Frame& Frame::operator=(Frame&& other) noexcept
+{
+	if (this == &other) {
+		return *this;
+	}
+	m_grid_size = other.m_grid_size;
+	/* the moved-from Frame is left empty without allocating: it shares
+	 * one empty image, which detach() clones before any write */
+	static shared_ptr<image_t> const empty_image = make_shared<image_t>();
+	m_image = exchange(other.m_image, empty_image);
+	m_gray = atomic_exchange(&other.m_gray, shared_ptr<image_t const>());
+	m_features = move(other.m_features);
+	return *this;
+}
+
+void Frame::markModified()
+{
+	atomic_store(&m_gray, shared_ptr<image_t const>());
 }
 
 void Frame::crop(Rec const& rec)
 {
-	cv::Range row_range(rec.top(), rec.bottom());
-	cv::Range col_range(rec.left(), rec.right());
-	m_image = make_unique<image_t>(*m_image, row_range, col_range);
+	cv::Range row_range(rec.top(), rec.bottom() + 1);
+	cv::Range col_range(rec.left(), rec.right() + 1);
+	m_gray.reset();
+	if (m_image.use_count() > 1) {
+		/* only the region needs to be copied out of the shared image */
+		m_image = make_shared<image_t>((*m_image)(row_range, col_range).clone());
+	} else {
+		m_image = make_shared<image_t>(*m_image, row_range, col_range);
+	}
+}
+
+Frame Frame::cropped(Rec const& rec) const
+{
+	cv::Range row_range(rec.top(), rec.bottom() + 1);
+	cv::Range col_range(rec.left(), rec.right() + 1);
+	Frame rtv;
+	rtv.m_grid_size = m_grid_size;
+	(*m_image)(row_range, col_range).copyTo(*rtv.m_image);
+	return rtv;
 }
 
 Frame& Frame::operator=(Frame const& other)
 {
 	m_grid_size = other.m_grid_size;
-	m_image = make_unique<image_t>(*other.m_image);
+	m_image = other.m_image;
+	m_gray = atomic_load(&other.m_gray);
+	m_features = other.m_features;
 	return *this;
 }
 
@@ -379,6 +642,7 @@ ostream& ggframe::operator<<(ostream& out, Rec const& rec)
 
 void Frame::resize(ggframe::Size const& size)
 {
+	detach();
 	m_image->resize(size.width(), size.height());
 }
 
@@ -389,6 +653,123 @@ uint8_t* Frame::data() const
 
 uint8_t* Frame::data()
 {
+	detach();
 	return m_image->data;
 }
 
+
+uint8_t const* Frame::row(unsigned r) const
+{
+	return m_image->ptr(r);
+}
+
+uint8_t* Frame::row(unsigned r)
+{
+	detach();
+	return m_image->ptr(r);
+}
+
+size_t Frame::stride() const
+{
+	return m_image->step;
+}
+
+bool Frame::isContinuous() const
+{
+	return m_image->isContinuous();
+}
+
+void Frame::compact()
+{
+	if (!isContinuous()) {
+		m_image = make_shared<image_t>(m_image->clone());
+	}
+}
+
+void Frame::fill(Rec const& rec, Color color, uint8_t v)
+{
+	Rec clipped = rec.intersect(frameRec());
+	/* frameRec() of a frame without pixels is 1x1, not empty */
+	if (empty() || clipped.empty()) {
+		return;
+	}
+	detach();
+	unsigned ci = colorIndex(color);
+	for (int r = clipped.top(); r <= clipped.bottom(); r++) {
+		uint8_t* px = m_image->ptr(r, clipped.left()) + ci;
+		for (unsigned c = 0; c < clipped.width(); c++, px += 4) {
+			*px = v;
+		}
+	}
+}
+
+void Frame::fill(Rec const& rec, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	Rec clipped = rec.intersect(frameRec());
+	if (empty() || clipped.empty()) {
+		return;
+	}
+	detach();
+	(*m_image)(toCvRect(clipped)).setTo(cv::Scalar(b, g, r, a));
+}
+
+void Frame::copyFrom(Frame const& src, Rec const& src_rec, Pos const& dst)
+{
+	Rec from = src_rec.intersect(src.frameRec());
+	if (empty() || src.empty() || from.empty()) {
+		return;
+	}
+	Rec to = Rec::tlbr(dst.row(), dst.col(),
+		dst.row() + from.height() - 1, dst.col() + from.width() - 1).intersect(frameRec());
+	if (to.empty()) {
+		return;
+	}
+	/* shrink the source to whatever part landed inside this frame */
+	from = Rec::tlbr(from.top() + to.top() - dst.row(), from.left() + to.left() - dst.col(),
+		from.top() + to.bottom() - dst.row(), from.left() + to.right() - dst.col());
+	detach();
+	(*src.m_image)(toCvRect(from)).copyTo((*m_image)(toCvRect(to)));
+}
+
+void Frame::channel(Color color, uint8_t* dst, size_t dst_stride) const
+{
+	Mat plane(nRows(), nCols(), CV_8U, dst, dst_stride);
+	cv::extractChannel(*m_image, plane, colorIndex(color));
+}
+
+void Frame::setChannel(Color color, uint8_t const* src, size_t src_stride)
+{
+	detach();
+	Mat plane(nRows(), nCols(), CV_8U, const_cast<uint8_t*>(src), src_stride);
+	cv::insertChannel(plane, *m_image, colorIndex(color));
+}
+
+void ggframe::convertPixels(cv::Mat const& src, PixelFormat from, cv::Mat& dst, PixelFormat to)
+{
+	if (from == to) {
+		src.copyTo(dst);
+		return;
+	}
+	if (to == PixelFormat::Gray8) {
+		Mat bgra;
+		if (from == PixelFormat::BGR8) {
+			cv::cvtColor(src, bgra, cv::COLOR_BGR2BGRA);
+		} else {
+			bgra = src;
+		}
+		dst.create(src.rows, src.cols, CV_8UC1);
+		for (int r = 0; r < src.rows; r++) {
+			maxRGB(bgra.ptr(r), dst.ptr(r), src.cols);
+		}
+		return;
+	}
+	int code = 0;
+	if (from == PixelFormat::BGRA8) {
+		code = cv::COLOR_BGRA2BGR;
+	} else if (from == PixelFormat::BGR8) {
+		code = cv::COLOR_BGR2BGRA;
+	} else {
+		code = to == PixelFormat::BGRA8 ? cv::COLOR_GRAY2BGRA : cv::COLOR_GRAY2BGR;
+	}
+	cv::cvtColor(src, dst, code);
+}
@@ -0,0 +1,101 @@
+#include <ggframe.h>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace ggframe;
+
+Pattern::Pattern(Frame const& frame)
+	: Pattern(frame, frame.featureContext())
+{
+}
+
+Pattern::Pattern(Frame const& frame, FeatureContext& ctx)
+{
+	compute(frame, ctx);
+}
+
+void Pattern::compute(Frame const& frame, FeatureContext& ctx)
+{
+	m_nrows = frame.nRows();
+	m_ncols = frame.nCols();
+	m_backend = ctx.featureOptions().backend;
+	if (frame.empty()) {
+		ctx.detectAndCompute(frame.cvMat(), m_keypoints, m_descriptors);
+		return;
+	}
+	/* detectors skip a border as wide as their patch, which on a small
+	 * sprite is most of it: extend the edges and only keep keypoints
+	 * on the sprite itself */
+	int pad = FeatureContext::roi_margin;
+	cv::Mat const& gray = frame.cvMat();
+	cv::Mat padded;
+	cv::copyMakeBorder(gray, padded, pad, pad, pad, pad, cv::BORDER_REPLICATE);
+	cv::Mat mask = cv::Mat::zeros(padded.size(), CV_8U);
+	cv::Mat inner = mask(cv::Rect(pad, pad, gray.cols, gray.rows));
+	uint8_t min_alpha = ctx.featureOptions().minAlpha;
+	if (min_alpha > 0) {
+		/* no keypoint may sit on a transparent pixel */
+		cv::Mat alpha;
+		cv::extractChannel(*frame.m_image, alpha, 3);
+		cv::compare(alpha, min_alpha, inner, cv::CMP_GE);
+	} else {
+		inner.setTo(255);
+	}
+	ctx.detectAndCompute(padded, m_keypoints, m_descriptors, mask);
+	for (KeyPoint& kp : m_keypoints) {
+		kp.pt.x -= pad;
+		kp.pt.y -= pad;
+	}
+}
+
+unsigned Pattern::nCols() const
+{
+	return m_ncols;
+}
+
+unsigned Pattern::nRows() const
+{
+	return m_nrows;
+}
+
+size_t Pattern::nKeyPoints() const
+{
+	return m_keypoints.size();
+}
+
+FeatureBackend Pattern::backend() const
+{
+	return m_backend;
+}
+
+bool Pattern::empty() const
+{
+	return m_keypoints.empty();
+}
+
+void Pattern::save(path filepath) const
+{
+	cv::FileStorage fs(filepath.string(), cv::FileStorage::WRITE);
+	fs << "rows" << int(m_nrows);
+	fs << "cols" << int(m_ncols);
+	fs << "backend" << int(m_backend);
+	cv::write(fs, "keypoints", m_keypoints);
+	fs << "descriptors" << m_descriptors;
+}
+
+void Pattern::load(path filepath)
+{
+	cv::FileStorage fs(filepath.string(), cv::FileStorage::READ);
+	int rows = 0;
+	int cols = 0;
+	int backend = 0;
+	fs["rows"] >> rows;
+	fs["cols"] >> cols;
+	fs["backend"] >> backend;
+	m_nrows = rows;
+	m_ncols = cols;
+	m_backend = FeatureBackend(backend);
+	cv::read(fs["keypoints"], m_keypoints);
+	fs["descriptors"] >> m_descriptors;
+}
@@ -0,0 +1,159 @@
+#include <ggframe.h>
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+using namespace std;
+using namespace ggframe;
+
+namespace {
+
+	/* corners tracked from the last match for the optical flow */
+	int const flow_points = 32;
+
+	Rec shifted(Rec const& rec, int dy, int dx)
+	{
+		return Rec::tlbr(rec.top() + dy, rec.left() + dx, rec.bottom() + dy, rec.right() + dx);
+	}
+
+	Rec grown(Rec const& rec, float margin)
+	{
+		int dy = lround(rec.height() * margin);
+		int dx = lround(rec.width() * margin);
+		return Rec::tlbr(rec.top() - dy, rec.left() - dx, rec.bottom() + dy, rec.right() + dx);
+	}
+
+	cv::Rect toCvRect(Rec const& rec)
+	{
+		return cv::Rect(rec.left(), rec.top(), rec.width(), rec.height());
+	}
+
+	float median(vector<float>& values)
+	{
+		auto mid = values.begin() + values.size() / 2;
+		nth_element(values.begin(), mid, values.end());
+		return *mid;
+	}
+}
+
+PatternTracker::PatternTracker(Pattern pattern, TrackerOptions const& opts)
+	: PatternTracker(pattern, nullptr, opts)
+{
+}
+
+PatternTracker::PatternTracker(Pattern pattern, shared_ptr<FeatureContext> ctx, TrackerOptions const& opts)
+	: m_pattern(move(pattern))
+	, m_options(opts)
+	, m_features(move(ctx))
+{
+	if (!m_features) {
+		FeatureOptions features;
+		features.backend = m_pattern.backend();
+		m_features = make_shared<FeatureContext>(features);
+	}
+}
+
+optional<PatternMatch> PatternTracker::update(Frame const& frame)
+{
+	FeatureContext& ctx = *m_features;
+	if (m_last) {
+		Rec search = grown(flowWindow(frame), m_options.searchMargin).intersect(frame.frameRec());
+		if (!search.empty()) {
+			/* detectors skip a border as wide as their patch, so borrow the
+			 * search Rec plus that margin and keep keypoints in the Rec */
+			int margin = FeatureContext::roi_margin;
+			Rec window = Rec::tlbr(
+				search.top() - margin, search.left() - margin,
+				search.bottom() + margin, search.right() + margin
+			).intersect(frame.frameRec());
+			/* a Frame borrowing only the window's pixels, so that even its
+			 * grayscale is computed for the window alone */
+			Frame sub = frame.view(window).frame();
+			sub.extractScene(ctx, shifted(search, -window.top(), -window.left()));
+			sub.matchPattern(m_pattern, ctx);
+			optional<PatternMatch> match = sub.verifiedMatch(m_pattern, ctx);
+			if (match && match->confidence >= m_options.minConfidence) {
+				match->rec = shifted(match->rec, window.top(), window.left());
+				m_last = match;
+				if (m_options.opticalFlow) {
+					m_prev_gray = sub.cvMat();
+					m_prev_area = window;
+				}
+				return m_last;
+			}
+		}
+	}
+	m_full_searches++;
+	m_last = frame.locatePattern(m_pattern, ctx);
+	m_prev_gray.release();
+	if (m_last && m_options.opticalFlow) {
+		m_prev_area = grown(m_last->rec, m_options.searchMargin).intersect(frame.frameRec());
+		m_prev_gray = frame.cvMat()(toCvRect(m_prev_area));
+	}
+	return m_last;
+}
+
+Rec PatternTracker::flowWindow(Frame const& frame) const
+{
+	Rec const& last = m_last->rec;
+	Rec visible = m_prev_area.intersect(frame.frameRec());
+	if (m_prev_gray.empty() || visible.width() != m_prev_area.width()
+		|| visible.height() != m_prev_area.height()) {
+		return last;
+	}
+	/* only the area around the last match is compared, in both frames */
+	cv::Mat current = frame.view(m_prev_area).frame().cvMat();
+	Rec corners_rec = last.intersect(m_prev_area);
+	if (corners_rec.empty()) {
+		return last;
+	}
+	cv::Rect corners_roi = toCvRect(corners_rec) - cv::Point(m_prev_area.left(), m_prev_area.top());
+	vector<cv::Point2f> prev_pts;
+	cv::goodFeaturesToTrack(m_prev_gray(corners_roi), prev_pts, flow_points, 0.01, 3);
+	if (prev_pts.empty()) {
+		return last;
+	}
+	for (cv::Point2f& p : prev_pts) {
+		p += cv::Point2f(corners_roi.tl());
+	}
+	vector<cv::Point2f> next_pts;
+	vector<uchar> status;
+	vector<float> err;
+	cv::calcOpticalFlowPyrLK(m_prev_gray, current, prev_pts, next_pts, status, err);
+	vector<float> dx;
+	vector<float> dy;
+	for (size_t i = 0; i < prev_pts.size(); i++) {
+		if (status[i]) {
+			dx.push_back(next_pts[i].x - prev_pts[i].x);
+			dy.push_back(next_pts[i].y - prev_pts[i].y);
+		}
+	}
+	if (dx.empty()) {
+		return last;
+	}
+	/* the median ignores corners that belong to the background */
+	return shifted(last, lround(median(dy)), lround(median(dx)));
+}
+
+optional<PatternMatch> const& PatternTracker::last() const
+{
+	return m_last;
+}
+
+void PatternTracker::reset()
+{
+	m_last.reset();
+	m_prev_gray.release();
+}
+
+size_t PatternTracker::nFullSearches() const
+{
+	return m_full_searches;
+}
+
+FeatureContext& PatternTracker::featureContext()
+{
+	return *m_features;
+}
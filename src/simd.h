@@ -0,0 +1,17 @@
+#pragma once
+
+/* Kernels pick their SIMD path at compile time per architecture: AVX2
+ * functions are built with GGFRAME_TARGET_AVX2 and only called after
+ * cv::checkHardwareSupport(CV_CPU_AVX2), NEON is always there on ARM. */
+#if defined(__x86_64__) || defined(_M_X64)
+#define GGFRAME_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define GGFRAME_TARGET_AVX2
+#else
+#define GGFRAME_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON)
+#define GGFRAME_NEON 1
+#include <arm_neon.h>
+#endif
@@ -0,0 +1,342 @@
+#include <ggframe.h>
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace ggframe;
+
+namespace {
+
+	/* pixels around the upsampled position searched on each finer level */
+	int const refine_radius = 2;
+
+	struct Candidate
+	{
+		cv::Point loc;
+		float score;
+		/* index into the Template's scale variants */
+		size_t variant;
+	};
+
+	/* sum of absolute differences of two rows of n bytes */
+#if GGFRAME_X86
+	GGFRAME_TARGET_AVX2
+	unsigned rowSadAvx2(uchar const* a, uchar const* b, int n, int& c)
+	{
+		/* _mm256_sad_epu8 leaves four 64 bit partial sums */
+		__m256i acc = _mm256_setzero_si256();
+		for (; c + 32 <= n; c += 32) {
+			__m256i va = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + c));
+			__m256i vb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + c));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+		}
+		__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		return _mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2);
+	}
+#endif
+
+	unsigned rowSad(uchar const* a, uchar const* b, int n)
+	{
+		unsigned sad = 0;
+		int c = 0;
+#if GGFRAME_X86
+		static bool const has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+		if (has_avx2) {
+			sad = rowSadAvx2(a, b, n, c);
+		}
+#elif GGFRAME_NEON
+		uint32x4_t acc = vdupq_n_u32(0);
+		for (; c + 16 <= n; c += 16) {
+			uint8x16_t d = vabdq_u8(vld1q_u8(a + c), vld1q_u8(b + c));
+			acc = vpadalq_u16(acc, vpaddlq_u8(d));
+		}
+		uint64x2_t halves = vpaddlq_u32(acc);
+		sad = vgetq_lane_u64(halves, 0) + vgetq_lane_u64(halves, 1);
+#endif
+		for (; c < n; c++) {
+			sad += abs(a[c] - b[c]);
+		}
+		return sad;
+	}
+
+	/* same scores as below, but only ever reading the opaque pixels */
+	void maskedScoreMap(cv::Mat const& scene, cv::Mat const& templ, vector<cv::Point> const& opaque,
+		TemplateMetric metric, cv::Mat& scores)
+	{
+		scores.create(scene.rows - templ.rows + 1, scene.cols - templ.cols + 1, CV_32F);
+		size_t n = opaque.size();
+		vector<size_t> offset(n);
+		vector<int> value(n);
+		double mean = 0;
+		for (size_t k = 0; k < n; k++) {
+			cv::Point const& p = opaque[k];
+			offset[k] = p.y * scene.step + p.x;
+			value[k] = templ.at<uchar>(p);
+			mean += value[k];
+		}
+		mean /= n;
+		if (metric == TemplateMetric::Sad) {
+			double scale = 1.0 / (255.0 * n);
+			for (int y = 0; y < scores.rows; y++) {
+				float* out = scores.ptr<float>(y);
+				for (int x = 0; x < scores.cols; x++) {
+					uchar const* base = scene.ptr(y, x);
+					int sad = 0;
+					for (size_t k = 0; k < n; k++) {
+						sad += abs(base[offset[k]] - value[k]);
+					}
+					out[x] = 1 - sad * scale;
+				}
+			}
+			return;
+		}
+		/* the template is centred, so the scene mean drops out of the cross term */
+		vector<float> centred(n);
+		double templ_var = 0;
+		for (size_t k = 0; k < n; k++) {
+			centred[k] = value[k] - mean;
+			templ_var += centred[k] * centred[k];
+		}
+		for (int y = 0; y < scores.rows; y++) {
+			float* out = scores.ptr<float>(y);
+			for (int x = 0; x < scores.cols; x++) {
+				uchar const* base = scene.ptr(y, x);
+				int64_t sum = 0;
+				int64_t sum_sq = 0;
+				float cross = 0;
+				for (size_t k = 0; k < n; k++) {
+					int v = base[offset[k]];
+					sum += v;
+					sum_sq += v * v;
+					cross += v * centred[k];
+				}
+				double den = sqrt((sum_sq - double(sum) * sum / n) * templ_var);
+				out[x] = den > 1e-6 ? cross / den : 0;
+			}
+		}
+	}
+
+	void scoreMap(cv::Mat const& scene, cv::Mat const& templ, vector<cv::Point> const& opaque,
+		TemplateMetric metric, cv::Mat& scores)
+	{
+		if (!opaque.empty()) {
+			maskedScoreMap(scene, templ, opaque, metric, scores);
+			return;
+		}
+		if (metric == TemplateMetric::Ncc) {
+			cv::matchTemplate(scene, templ, scores, cv::TM_CCOEFF_NORMED);
+			/* a flat template or window has no correlation at all */
+			cv::patchNaNs(scores, 0);
+			return;
+		}
+		scores.create(scene.rows - templ.rows + 1, scene.cols - templ.cols + 1, CV_32F);
+		double scale = 1.0 / (255.0 * templ.total());
+		for (int y = 0; y < scores.rows; y++) {
+			float* out = scores.ptr<float>(y);
+			for (int x = 0; x < scores.cols; x++) {
+				unsigned sad = 0;
+				for (int r = 0; r < templ.rows; r++) {
+					sad += rowSad(scene.ptr(y + r) + x, templ.ptr(r), templ.cols);
+				}
+				out[x] = 1 - sad * scale;
+			}
+		}
+	}
+
+	/* best n positions of a score map, blanking a template-sized area
+	 * around each one so that one match is not reported twice */
+	void peaks(cv::Mat& scores, unsigned n, cv::Size templ, size_t variant, vector<Candidate>& out)
+	{
+		float const blank = -numeric_limits<float>::max();
+		for (unsigned i = 0; i < n; i++) {
+			double score;
+			cv::Point loc;
+			cv::minMaxLoc(scores, nullptr, &score, nullptr, &loc);
+			if (score == blank) {
+				return;
+			}
+			out.push_back({ loc, float(score), variant });
+			cv::Rect around(loc.x - templ.width / 2, loc.y - templ.height / 2, templ.width, templ.height);
+			scores(around & cv::Rect(0, 0, scores.cols, scores.rows)).setTo(blank);
+		}
+	}
+}
+
+Template::Template(Frame const& templ, TemplateOptions const& opts)
+	: m_options(opts)
+{
+	if (templ.empty()) {
+		return;
+	}
+	for (float scale : opts.scales) {
+		if (scale == 1) {
+			addVariant(templ, scale);
+			continue;
+		}
+		unsigned nrows = lround(templ.nRows() * scale);
+		unsigned ncols = lround(templ.nCols() * scale);
+		if (nrows == 0 || ncols == 0) {
+			continue;
+		}
+		Frame scaled;
+		cv::resize(*templ.m_image, *scaled.m_image, cv::Size(ncols, nrows), 0, 0,
+			scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+		addVariant(scaled, scale);
+	}
+}
+
+void Template::addVariant(Frame const& templ, float scale)
+{
+	TemplateOptions const& opts = m_options;
+	int levels = opts.levels;
+	if (levels < 0) {
+		levels = 0;
+		unsigned side = min(templ.nRows(), templ.nCols());
+		while ((side >> (levels + 1)) >= max(opts.minTemplateSize, 1u)) {
+			levels++;
+		}
+	}
+	Variant variant;
+	variant.scale = scale;
+	variant.nrows = templ.nRows();
+	variant.ncols = templ.nCols();
+	variant.levels.resize(levels + 1);
+	variant.levels[0].gray = templ.cvMat();
+	for (int l = 1; l <= levels; l++) {
+		cv::pyrDown(variant.levels[l - 1].gray, variant.levels[l].gray);
+	}
+	if (opts.minAlpha > 0) {
+		cv::Mat alpha;
+		cv::Mat opaque;
+		cv::extractChannel(*templ.m_image, alpha, 3);
+		for (int l = 0; l <= levels; l++) {
+			if (l > 0) {
+				cv::pyrDown(alpha, alpha);
+			}
+			cv::compare(alpha, opts.minAlpha, opaque, cv::CMP_GE);
+			int n = cv::countNonZero(opaque);
+			if (n == 0) {
+				/* too thin to survive downsampling, search finer levels only */
+				if (l == 0) {
+					return;
+				}
+				variant.levels.resize(l);
+				break;
+			}
+			if (n < int(opaque.total())) {
+				cv::findNonZero(opaque, variant.levels[l].opaque);
+			}
+		}
+	}
+	m_variants.push_back(move(variant));
+}
+
+TemplateOptions const& Template::options() const
+{
+	return m_options;
+}
+
+bool Template::empty() const
+{
+	return m_variants.empty();
+}
+
+vector<TemplateMatch> Frame::findTemplate(Frame const& templ, TemplateOptions const& opts) const
+{
+	return findTemplate(Template(templ, opts));
+}
+
+vector<TemplateMatch> Frame::findTemplate(Template const& templ) const
+{
+	TemplateOptions const& opts = templ.m_options;
+	vector<TemplateMatch> rtv;
+	if (empty() || opts.topK == 0) {
+		return rtv;
+	}
+	/* one scene pyramid, as deep as the deepest scale needs */
+	vector<cv::Mat> scene_pyr(1, cvMat());
+	vector<Candidate> candidates;
+	vector<float> coarse_best(templ.m_variants.size(), -numeric_limits<float>::max());
+	cv::Mat scores;
+	for (size_t v = 0; v < templ.m_variants.size(); v++) {
+		Template::Variant const& variant = templ.m_variants[v];
+		if (variant.nrows > nRows() || variant.ncols > nCols()) {
+			continue;
+		}
+		size_t top = variant.levels.size() - 1;
+		while (scene_pyr.size() <= top) {
+			scene_pyr.emplace_back();
+			cv::pyrDown(scene_pyr[scene_pyr.size() - 2], scene_pyr.back());
+		}
+		Template::Level const& level = variant.levels[top];
+		scoreMap(scene_pyr[top], level.gray, level.opaque, opts.metric, scores);
+		/* keep a few spare candidates, refinement can merge or demote some */
+		size_t first = candidates.size();
+		peaks(scores, opts.topK * 2 + 2, level.gray.size(), v, candidates);
+		if (candidates.size() > first) {
+			coarse_best[v] = candidates[first].score;
+		}
+	}
+	if (candidates.empty()) {
+		return rtv;
+	}
+
+	/* a scale that is clearly worse on the coarse level is not refined */
+	float best = *max_element(coarse_best.begin(), coarse_best.end());
+	candidates.erase(remove_if(candidates.begin(), candidates.end(), [&](Candidate const& cand) {
+		return coarse_best[cand.variant] < best - opts.scalePruning;
+	}), candidates.end());
+
+	for (Candidate& cand : candidates) {
+		Template::Variant const& variant = templ.m_variants[cand.variant];
+		for (int l = int(variant.levels.size()) - 2; l >= 0; l--) {
+			cv::Mat const& scene = scene_pyr[l];
+			Template::Level const& level = variant.levels[l];
+			cv::Mat const& pattern = level.gray;
+			cv::Rect window(
+				cand.loc.x * 2 - refine_radius, cand.loc.y * 2 - refine_radius,
+				pattern.cols + 2 * refine_radius, pattern.rows + 2 * refine_radius
+			);
+			window &= cv::Rect(0, 0, scene.cols, scene.rows);
+			if (window.width < pattern.cols || window.height < pattern.rows) {
+				cand.score = -numeric_limits<float>::max();
+				break;
+			}
+			double score;
+			cv::Point loc;
+			scoreMap(scene(window), pattern, level.opaque, opts.metric, scores);
+			cv::minMaxLoc(scores, nullptr, &score, nullptr, &loc);
+			cand.loc = window.tl() + loc;
+			cand.score = score;
+		}
+	}
+
+	sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+		return a.score > b.score;
+	});
+	for (Candidate const& cand : candidates) {
+		if (rtv.size() == opts.topK || cand.score < opts.minScore) {
+			break;
+		}
+		/* two candidates, possibly of different scales, can converge on the same spot */
+		bool repeated = any_of(rtv.begin(), rtv.end(), [&](TemplateMatch const& m) {
+			return abs(m.rec.left() - cand.loc.x) < int(m.rec.width()) / 2
+				&& abs(m.rec.top() - cand.loc.y) < int(m.rec.height()) / 2;
+		});
+		if (repeated) {
+			continue;
+		}
+		Template::Variant const& variant = templ.m_variants[cand.variant];
+		TemplateMatch match;
+		match.rec = Rec::tlbr(cand.loc.y, cand.loc.x,
+			cand.loc.y + variant.nrows - 1, cand.loc.x + variant.ncols - 1);
+		match.score = cand.score;
+		match.scale = variant.scale;
+		rtv.push_back(match);
+	}
+	return rtv;
+}
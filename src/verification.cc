@@ -0,0 +1,205 @@
+#include <ggframe.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace ggframe;
+
+namespace {
+
+	typedef cv::Matx33d model_t;
+
+	/* least squares similarity, exact for the minimal two point sample:
+	 * with points as complex numbers, q = a * p + t */
+	bool fitSimilarity(cv::Point2f const* p, cv::Point2f const* q, int n, model_t& model)
+	{
+		complex<double> p_mean = 0;
+		complex<double> q_mean = 0;
+		for (int i = 0; i < n; i++) {
+			p_mean += complex<double>(p[i].x, p[i].y);
+			q_mean += complex<double>(q[i].x, q[i].y);
+		}
+		p_mean /= n;
+		q_mean /= n;
+		complex<double> num = 0;
+		double den = 0;
+		for (int i = 0; i < n; i++) {
+			complex<double> dp = complex<double>(p[i].x, p[i].y) - p_mean;
+			complex<double> dq = complex<double>(q[i].x, q[i].y) - q_mean;
+			num += dq * conj(dp);
+			den += norm(dp);
+		}
+		if (den < 1e-9) {
+			return false;
+		}
+		complex<double> a = num / den;
+		complex<double> t = q_mean - a * p_mean;
+		model = model_t(
+			a.real(), -a.imag(), t.real(),
+			a.imag(), a.real(), t.imag(),
+			0, 0, 1
+		);
+		return true;
+	}
+
+	bool fitHomography(cv::Point2f const* p, cv::Point2f const* q, int n, model_t& model)
+	{
+		cv::Mat h;
+		if (n == 4) {
+			h = cv::getPerspectiveTransform(p, q);
+		} else {
+			h = cv::findHomography(vector<cv::Point2f>(p, p + n), vector<cv::Point2f>(q, q + n), 0);
+		}
+		if (h.empty()) {
+			return false;
+		}
+		model = model_t(h);
+		return true;
+	}
+
+	bool project(model_t const& m, cv::Point2f const& p, cv::Point2f& out)
+	{
+		double w = m(2, 0) * p.x + m(2, 1) * p.y + m(2, 2);
+		if (abs(w) < 1e-12) {
+			return false;
+		}
+		out.x = (m(0, 0) * p.x + m(0, 1) * p.y + m(0, 2)) / w;
+		out.y = (m(1, 0) * p.x + m(1, 1) * p.y + m(1, 2)) / w;
+		return true;
+	}
+
+	unsigned countInliers(model_t const& m, vector<cv::Point2f> const& src,
+		vector<cv::Point2f> const& dst, float threshold, vector<uchar>* mask = nullptr)
+	{
+		float limit = threshold * threshold;
+		unsigned rtv = 0;
+		for (size_t i = 0; i < src.size(); i++) {
+			cv::Point2f p;
+			cv::Point2f d;
+			bool inlier = project(m, src[i], p)
+				&& (d = p - dst[i], d.dot(d) <= limit);
+			if (mask) {
+				(*mask)[i] = inlier;
+			}
+			rtv += inlier;
+		}
+		return rtv;
+	}
+}
+
+optional<PatternMatch> Frame::locatePattern(Pattern const& pattern) const
+{
+	return locatePattern(pattern, featureContext());
+}
+
+optional<PatternMatch> Frame::locatePattern(Pattern const& pattern, FeatureContext& ctx) const
+{
+	extractScene(ctx);
+	matchPattern(pattern, ctx);
+	return verifiedMatch(pattern, ctx);
+}
+
+optional<PatternMatch> Frame::verifiedMatch(Pattern const& pattern, FeatureContext const& ctx) const
+{
+	MatchOptions const& opts = ctx.matchOptions();
+	bool similarity = opts.verification == Verification::Similarity;
+	auto fit = similarity ? fitSimilarity : fitHomography;
+	int sample_size = similarity ? 2 : 4;
+	vector<DMatch> const& matches = ctx.m_matches;
+	int n = matches.size();
+	unsigned needed = std::max<unsigned>(opts.minInliers, sample_size);
+	if (n < int(needed)) {
+		return nullopt;
+	}
+	vector<cv::Point2f> src(n);
+	vector<cv::Point2f> dst(n);
+	for (int i = 0; i < n; i++) {
+		src[i] = pattern.m_keypoints[matches[i].queryIdx].pt;
+		dst[i] = ctx.m_scene_kps[matches[i].trainIdx].pt;
+	}
+
+	/* fixed seed, so the same frame always gives the same answer */
+	cv::RNG rng(0x6767);
+	model_t best;
+	unsigned best_inliers = 0;
+	for (unsigned iter = 0; iter < opts.maxIterations && best_inliers < needed; iter++) {
+		int idx[4];
+		cv::Point2f ps[4];
+		cv::Point2f qs[4];
+		for (int k = 0; k < sample_size; k++) {
+			bool repeated = true;
+			while (repeated) {
+				idx[k] = rng.uniform(0, n);
+				repeated = find(idx, idx + k, idx[k]) != idx + k;
+			}
+			ps[k] = src[idx[k]];
+			qs[k] = dst[idx[k]];
+		}
+		model_t model;
+		if (!fit(ps, qs, sample_size, model)) {
+			continue;
+		}
+		unsigned inliers = countInliers(model, src, dst, opts.inlierThreshold);
+		if (inliers > best_inliers) {
+			best = model;
+			best_inliers = inliers;
+		}
+	}
+	if (best_inliers < needed) {
+		return nullopt;
+	}
+
+	/* refit on every inlier of the best sample */
+	vector<uchar> mask(n);
+	countInliers(best, src, dst, opts.inlierThreshold, &mask);
+	vector<cv::Point2f> src_in;
+	vector<cv::Point2f> dst_in;
+	for (int i = 0; i < n; i++) {
+		if (mask[i]) {
+			src_in.push_back(src[i]);
+			dst_in.push_back(dst[i]);
+		}
+	}
+	model_t refined;
+	if (fit(src_in.data(), dst_in.data(), src_in.size(), refined)) {
+		unsigned inliers = countInliers(refined, src, dst, opts.inlierThreshold);
+		if (inliers >= best_inliers) {
+			best = refined;
+			best_inliers = inliers;
+		}
+	}
+
+	float w = pattern.nCols() > 0 ? pattern.nCols() - 1 : 0;
+	float h = pattern.nRows() > 0 ? pattern.nRows() - 1 : 0;
+	cv::Point2f corners[4] = { {0, 0}, {w, 0}, {w, h}, {0, h} };
+	float min_x = numeric_limits<float>::max();
+	float min_y = min_x;
+	float max_x = numeric_limits<float>::lowest();
+	float max_y = max_x;
+	for (cv::Point2f const& corner : corners) {
+		cv::Point2f p;
+		if (!project(best, corner, p)) {
+			return nullopt;
+		}
+		min_x = min(min_x, p.x);
+		min_y = min(min_y, p.y);
+		max_x = max(max_x, p.x);
+		max_y = max(max_y, p.y);
+	}
+	Rec rec = Rec::tlbr(floor(min_y), floor(min_x), ceil(max_y), ceil(max_x)).intersect(frameRec());
+	if (rec.empty()) {
+		return nullopt;
+	}
+	PatternMatch rtv;
+	rtv.rec = rec;
+	rtv.inliers = best_inliers;
+	rtv.confidence = float(best_inliers) / n;
+	/* exact for a similarity, ignores perspective for a homography */
+	rtv.scale = sqrt(abs(best(0, 0) * best(1, 1) - best(0, 1) * best(1, 0)) / (best(2, 2) * best(2, 2)));
+	return rtv;
+}
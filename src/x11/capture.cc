@@ -0,0 +1,192 @@
+#include <ggframe.h>
+#include <stdexcept>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+using namespace std;
+using namespace ggframe;
+
+struct ScreenCapture::Impl
+{
+	Display* display = nullptr;
+	::Window root = 0; /* ggframe::Window is an InputSource */
+	XImage* image = nullptr;
+	/* same segment as image, sized to the last Rec grabbed */
+	XImage* region = nullptr;
+	XShmSegmentInfo shminfo {};
+	bool attached = false;
+
+	~Impl()
+	{
+		if (attached) {
+			XShmDetach(display, &shminfo);
+		}
+		/* the data belongs to the segment, not to Xlib */
+		destroyImage(region);
+		destroyImage(image);
+		if (shminfo.shmaddr) {
+			shmdt(shminfo.shmaddr);
+		}
+		if (display) {
+			XCloseDisplay(display);
+		}
+	}
+
+	static void destroyImage(XImage* img)
+	{
+		if (img) {
+			img->data = nullptr;
+			XDestroyImage(img);
+		}
+	}
+
+	XImage* regionImage(unsigned w, unsigned h)
+	{
+		if (region && region->width == int(w) && region->height == int(h)) {
+			return region;
+		}
+		destroyImage(region);
+		region = XShmCreateImage(
+			display, DefaultVisual(display, DefaultScreen(display)), image->depth,
+			ZPixmap, nullptr, &shminfo, w, h
+		);
+		if (!region) {
+			throw runtime_error("ScreenCapture: XShmCreateImage failed");
+		}
+		region->data = shminfo.shmaddr;
+		return region;
+	}
+};
+
+ScreenCapture::ScreenCapture()
+	: ScreenCapture("")
+{
+}
+
+ScreenCapture::ScreenCapture(string const& display_name)
+	: m_impl(make_unique<Impl>())
+{
+	Impl& impl = *m_impl;
+	impl.display = XOpenDisplay(display_name.empty() ? nullptr : display_name.c_str());
+	if (!impl.display) {
+		throw runtime_error("ScreenCapture: cannot open X display");
+	}
+	if (!XShmQueryExtension(impl.display)) {
+		throw runtime_error("ScreenCapture: X server has no MIT-SHM extension");
+	}
+	int screen = DefaultScreen(impl.display);
+	impl.root = RootWindow(impl.display, screen);
+	XWindowAttributes attrs;
+	XGetWindowAttributes(impl.display, impl.root, &attrs);
+	impl.image = XShmCreateImage(
+		impl.display, attrs.visual, attrs.depth, ZPixmap,
+		nullptr, &impl.shminfo, attrs.width, attrs.height
+	);
+	if (!impl.image) {
+		throw runtime_error("ScreenCapture: XShmCreateImage failed");
+	}
+	if (impl.image->bits_per_pixel != 32) {
+		throw runtime_error("ScreenCapture: only 32 bits per pixel visuals are supported");
+	}
+	if (impl.image->byte_order != LSBFirst) {
+		throw runtime_error("ScreenCapture: only LSBFirst servers are supported");
+	}
+	impl.shminfo.shmid = shmget(
+		IPC_PRIVATE, impl.image->bytes_per_line * impl.image->height, IPC_CREAT | 0600
+	);
+	if (impl.shminfo.shmid < 0) {
+		throw runtime_error("ScreenCapture: shmget failed");
+	}
+	impl.shminfo.shmaddr = static_cast<char*>(shmat(impl.shminfo.shmid, nullptr, 0));
+	/* mark the segment for removal now, it goes away once both sides detach */
+	shmctl(impl.shminfo.shmid, IPC_RMID, nullptr);
+	if (impl.shminfo.shmaddr == reinterpret_cast<char*>(-1)) {
+		impl.shminfo.shmaddr = nullptr;
+		throw runtime_error("ScreenCapture: shmat failed");
+	}
+	impl.image->data = impl.shminfo.shmaddr;
+	impl.shminfo.readOnly = False;
+	if (!XShmAttach(impl.display, &impl.shminfo)) {
+		throw runtime_error("ScreenCapture: XShmAttach failed");
+	}
+	impl.attached = true;
+	XSync(impl.display, False);
+}
+
+ScreenCapture::~ScreenCapture() = default;
+
+unsigned ScreenCapture::nCols() const
+{
+	return m_impl->image->width;
+}
+
+unsigned ScreenCapture::nRows() const
+{
+	return m_impl->image->height;
+}
+
+Rec ScreenCapture::screenRec() const
+{
+	return Rec::tlbr(0, 0, nRows() - 1, nCols() - 1);
+}
+
+void ScreenCapture::grab(Frame& frame)
+{
+	Impl& impl = *m_impl;
+	if (!XShmGetImage(impl.display, impl.root, impl.image, 0, 0, AllPlanes)) {
+		throw runtime_error("ScreenCapture: XShmGetImage failed");
+	}
+	/* a 32 bpp ZPixmap on a little endian server is laid out as B,G,R,X,
+	 * where X is padding (0 on Xvfb); set it to an opaque alpha in place
+	 * and wrap the segment as BGRA */
+	frame.m_gray.reset();
+	frame.m_image = make_shared<Frame::image_t>(
+		impl.image->height, impl.image->width, CV_8UC4,
+		impl.image->data, impl.image->bytes_per_line
+	);
+	cv::bitwise_or(*frame.m_image, cv::Scalar(0, 0, 0, 255), *frame.m_image);
+}
+
+Frame ScreenCapture::grab()
+{
+	Frame frame;
+	grab(frame);
+	return frame;
+}
+
+void ScreenCapture::grab(Frame& frame, Rec const& rec)
+{
+	Impl& impl = *m_impl;
+	Rec clipped = rec.intersect(screenRec());
+	if (clipped.empty()) {
+		frame = Frame();
+		return;
+	}
+	XImage* region = impl.regionImage(clipped.width(), clipped.height());
+	if (!XShmGetImage(impl.display, impl.root, region, clipped.left(), clipped.top(), AllPlanes)) {
+		throw runtime_error("ScreenCapture: XShmGetImage failed");
+	}
+	cv::Mat src(region->height, region->width, CV_8UC4, region->data, region->bytes_per_line);
+	/* a Frame still pointing at the segment, or sharing its pixels with
+	 * copies, must not be written over */
+	if (frame.m_image->u == nullptr || frame.m_image.use_count() > 1) {
+		frame.m_image = make_shared<Frame::image_t>();
+	}
+	frame.m_gray.reset();
+	/* create() keeps the existing buffer when the size already matches */
+	frame.m_image->create(src.rows, src.cols, CV_8UC4);
+	src.copyTo(*frame.m_image);
+	/* the X byte is padding, not alpha */
+	cv::bitwise_or(*frame.m_image, cv::Scalar(0, 0, 0, 255), *frame.m_image);
+}
+
+Frame ScreenCapture::grab(Rec const& rec)
+{
+	Frame frame;
+	grab(frame, rec);
+	return frame;
+}